@@ -0,0 +1,154 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include "opencv2/opencv.hpp"
+#include "frame_cache_class.h"
+#include "frame_store_class.h"
+#include "lane_detect_processor.h"
+
+namespace {
+	//FNV-1a, continued from hash
+	uint64_t HashValue( uint64_t hash,
+						int64_t value )
+	{
+		for ( int i = 0; i < 8; i++ ) {
+			hash ^= static_cast<uint64_t>(value >> (8 * i)) & 0xff;
+			hash *= 1099511628211ULL;
+		}
+		return hash;
+	}
+}
+
+FrameCache::FrameCache( uint64_t budgetbytes,
+						bool usestore,
+						const RawVideoFormat& rawformat,
+						int downscale ):
+						budgetbytes_{ budgetbytes },
+						usestore_{ usestore },
+						rawformat_( rawformat ),
+						downscale_{ downscale },
+						usedbytes_{0},
+						cachedframes_{0}
+{
+}
+
+void FrameCache::Load( const std::vector<std::string>& filenames )
+{
+	cached_.assign( filenames.size(), false );
+	frames_.assign( filenames.size(), std::vector<cv::Mat>() );
+	stores_.clear();
+
+	for ( int i = 0; i < filenames.size(); i++ ) {
+		stores_.push_back( std::unique_ptr<FrameStore>(new FrameStore()) );
+		if ( usestore_ ) {
+			cached_[i] = LoadStore( filenames[i], *stores_[i], frames_[i] );
+		}
+		if ( !cached_[i] ) {
+			cached_[i] = LoadFile( filenames[i], frames_[i] );
+		}
+		if ( cached_[i] ) {
+			cachedframes_ += frames_[i].size();
+			std::cout << "Cached " << filenames[i] << ", " << frames_[i].size()
+					  << " frames" << std::endl;
+		} else {
+			std::cout << "Not cached " << filenames[i] << ", will be decoded every "
+					  << "iteration" << std::endl;
+		}
+	}
+	std::cout << "Frame cache using " << (usedbytes_ / (1024 * 1024)) << " of "
+			  << (budgetbytes_ / (1024 * 1024)) << " MB" << std::endl;
+
+	return;
+}
+
+bool FrameCache::IsCached( int fileindex ) const
+{
+	return cached_[fileindex];
+}
+
+const std::vector<cv::Mat>& FrameCache::Frames( int fileindex ) const
+{
+	return frames_[fileindex];
+}
+
+bool FrameCache::LoadStore( const std::string& filename,
+							FrameStore& store,
+							std::vector<cv::Mat>& frames )
+{
+	//Each downscale keeps its own store
+	std::string storefilename{ filename + ".ldstore" };
+	if ( downscale_ > 1 ) {
+		storefilename = filename + ".d" + std::to_string(downscale_) + ".ldstore";
+	}
+	uint64_t sourcehash{ FrameStore::HashFile(filename) };
+
+	//A raw file is only frames given the size and layout it was read with, a store
+	//sliced with another is rebuilt
+	if ( FrameReader::IsRawFile(filename) ) {
+		sourcehash = HashValue( sourcehash, rawformat_.framesize.width );
+		sourcehash = HashValue( sourcehash, rawformat_.framesize.height );
+		sourcehash = HashValue( sourcehash, static_cast<int64_t>(rawformat_.format) );
+	}
+
+	//Build store on first run, decoding straight to disk
+	if ( !store.Open(storefilename, sourcehash) ) {
+		FrameReader reader( filename, rawformat_ );
+		if ( !reader.IsOpened() ) return false;
+		std::cout << "Building frame store " << storefilename << std::endl;
+		FrameStoreWriter writer( storefilename, sourcehash );
+		int framecount{ reader.ReadableFrames() };
+		cv::Mat frame;
+		cv::Mat blurredframe;
+		ProcessingWorkspace workspace;
+		for ( int i = 0; i < framecount; i++ ) {
+			if ( !reader.Read(frame) ) break;
+			PreprocessImage( frame, blurredframe, &workspace, nullptr, downscale_ );
+			if ( !writer.Append(blurredframe) ) break;
+		}
+		reader.Release();
+		if ( !writer.Finish() ) return false;
+		if ( !store.Open(storefilename, sourcehash) ) return false;
+	}
+
+	//Frames are headers into the mapping, nothing counted against the budget
+	frames.reserve( store.header_.framecount );
+	for ( uint32_t i = 0; i < store.header_.framecount; i++ ) {
+		frames.push_back( store.Frame(i) );
+	}
+
+	return true;
+}
+
+bool FrameCache::LoadFile( const std::string& filename,
+						   std::vector<cv::Mat>& frames )
+{
+	FrameReader reader( filename, rawformat_ );
+	if ( !reader.IsOpened() ) return false;
+
+	//Estimate size before decoding so files that can't fit aren't decoded for nothing
+	int framecount{ reader.ReadableFrames() };
+	uint64_t framebytes{ static_cast<uint64_t>(reader.FrameSize().area()) /
+						 (downscale_ * downscale_) };
+	if ( (usedbytes_ + framebytes * framecount) > budgetbytes_ ) return false;
+
+	//Same frame range as FrameLoaderThread
+	frames.reserve( framecount );
+	uint64_t filebytes{0};
+	cv::Mat frame;
+	for ( int i = 0; i < framecount; i++ ) {
+		if ( !reader.Read(frame) ) break;
+		cv::Mat blurredframe;
+		PreprocessImage( frame, blurredframe, nullptr, nullptr, downscale_ );
+		filebytes += blurredframe.total() * blurredframe.elemSize();
+		if ( (usedbytes_ + filebytes) > budgetbytes_ ) {
+			std::vector<cv::Mat>().swap( frames );
+			return false;
+		}
+		frames.push_back( blurredframe );
+	}
+	reader.Release();
+	usedbytes_ += filebytes;
+
+	return true;
+}
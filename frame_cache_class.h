@@ -0,0 +1,46 @@
+#ifndef FRAMECACHE_H
+#define FRAMECACHE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include "opencv2/opencv.hpp"
+#include "frame_store_class.h"
+#include "frame_reader_class.h"
+
+//Decodes each video file once and keeps grayscale+blurred frames so that every sweep
+//iteration after the first skips decode, colour conversion and blur.  With the store
+//enabled frames come from a memory mapped file built on the first run, otherwise they
+//are held in memory.  Files which do not fit the memory budget are left uncached and
+//must be streamed by the caller.
+class FrameCache
+{
+	public:
+		FrameCache( uint64_t budgetbytes,
+					bool usestore,
+					const RawVideoFormat& rawformat,
+					int downscale );
+		void Load( const std::vector<std::string>& filenames );
+		bool IsCached( int fileindex ) const;
+		const std::vector<cv::Mat>& Frames( int fileindex ) const;
+		uint64_t usedbytes_;
+		uint32_t cachedframes_;
+
+	protected:
+
+	private:
+		bool LoadStore( const std::string& filename,
+						FrameStore& store,
+						std::vector<cv::Mat>& frames );
+		bool LoadFile( const std::string& filename,
+					   std::vector<cv::Mat>& frames );
+		uint64_t budgetbytes_;
+		bool usestore_;
+		RawVideoFormat rawformat_;
+		int downscale_;
+		std::vector<bool> cached_;
+		std::vector< std::vector<cv::Mat> > frames_;
+		std::vector< std::unique_ptr<FrameStore> > stores_;
+};
+
+#endif // FRAMECACHE_H
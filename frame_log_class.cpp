@@ -0,0 +1,433 @@
+#include <string>
+#include <fstream>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstring>
+#include "opencv2/opencv.hpp"
+#include "frame_log_class.h"
+#include "result_values_class.h"
+
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+namespace {
+	const char k_logmagic[8]{ 'L', 'D', 'F', 'R', 'A', 'M', 'E', 'S' };
+	const uint32_t k_logversion{ 3 };
+
+	//Maps points to unsigned values in the same order
+	const uint32_t k_pointbias{ 0x80000000u };
+
+	uint64_t FileStartsBytes( uint32_t filecount )
+	{
+		return ((filecount * sizeof(uint32_t) + 7) / 8) * 8;
+	}
+
+	uint64_t FixedSegmentBytes( const FrameLogSegment& segment,
+								uint32_t valuecount )
+	{
+		return sizeof(FrameLogSegment) + valuecount * sizeof(double) +
+			   static_cast<uint64_t>(segment.blockcount) * k_logcolumns *
+			   sizeof(FrameLogBlock);
+	}
+
+	uint64_t PackedWords( uint32_t count,
+						  uint32_t bitwidth )
+	{
+		return (static_cast<uint64_t>(count) * bitwidth + 63) / 64;
+	}
+
+	uint32_t BitWidth( uint32_t range )
+	{
+		uint32_t bitwidth{0};
+		while ( range != 0 ) {
+			bitwidth++;
+			range >>= 1;
+		}
+		return bitwidth;
+	}
+
+	uint32_t ColumnValue( const FrameResult& row,
+						  int column )
+	{
+		switch ( column ) {
+			case kFrameColumn:
+				return row.frame;
+			case kDetectedColumn:
+				return row.detected ? 1 : 0;
+			case kMatchColumn:
+				//Fixed point, 0 to 10000 for a percent fits 14 bits where float bits take 30
+				return static_cast<uint16_t>( cvRound(std::min(std::max(row.match, 0.0f), 100.0f) *
+													  k_logmatchscale) );
+		}
+		const cv::Point& point{ row.polygon[(column - kPointColumn) / 2] };
+		int value{ ((column - kPointColumn) % 2 == 0) ? point.x : point.y };
+		return static_cast<uint32_t>(value) ^ k_pointbias;
+	}
+
+	//Values packed from the lowest bit of each word, one may span two words
+	void Pack( const uint32_t* values,
+			   uint32_t count,
+			   const FrameLogBlock& block,
+			   std::vector<uint64_t>& words )
+	{
+		words.resize( block.offset + PackedWords(count, block.bitwidth), 0 );
+		if ( block.bitwidth == 0 ) return;
+		uint64_t* packed{ words.data() + block.offset };
+		for ( uint32_t i = 0; i < count; i++ ) {
+			uint64_t value{ values[i] - block.reference };
+			uint64_t bit{ static_cast<uint64_t>(i) * block.bitwidth };
+			uint32_t shift{ static_cast<uint32_t>(bit % 64) };
+			packed[bit / 64] |= value << shift;
+			if ( (shift + block.bitwidth) > 64 ) packed[bit / 64 + 1] |= value >> (64 - shift);
+		}
+		return;
+	}
+
+	void Unpack( const uint64_t* words,
+				 const FrameLogBlock& block,
+				 uint32_t count,
+				 uint32_t* values )
+	{
+		if ( block.bitwidth == 0 ) {
+			std::fill( values, values + count, block.reference );
+			return;
+		}
+		const uint64_t* packed{ words + block.offset };
+		uint64_t mask{ (1ULL << block.bitwidth) - 1 };
+		for ( uint32_t i = 0; i < count; i++ ) {
+			uint64_t bit{ static_cast<uint64_t>(i) * block.bitwidth };
+			uint32_t shift{ static_cast<uint32_t>(bit % 64) };
+			uint64_t value{ packed[bit / 64] >> shift };
+			if ( (shift + block.bitwidth) > 64 ) value |= packed[bit / 64 + 1] << (64 - shift);
+			values[i] = block.reference + static_cast<uint32_t>(value & mask);
+		}
+		return;
+	}
+
+	bool Truncate( const std::string& filename,
+				   uint64_t bytes )
+	{
+#ifdef _WIN32
+		HANDLE file{ CreateFileA(filename.c_str(), GENERIC_WRITE, 0, NULL,
+								 OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL) };
+		if ( file == INVALID_HANDLE_VALUE ) return false;
+		LARGE_INTEGER size;
+		size.QuadPart = bytes;
+		bool truncated{ (SetFilePointerEx(file, size, NULL, FILE_BEGIN) != 0) &&
+						(SetEndOfFile(file) != 0) };
+		CloseHandle( file );
+		return truncated;
+#else
+		return truncate( filename.c_str(), bytes ) == 0;
+#endif
+	}
+}
+
+FrameLogReader::FrameLogReader():
+								validbytes_{0},
+								mapping_{nullptr},
+								mappingsize_{0}
+#ifdef _WIN32
+								, filehandle_{nullptr},
+								mappinghandle_{nullptr}
+#endif
+{
+	std::memset( &header_, 0, sizeof(header_) );
+}
+
+FrameLogReader::~FrameLogReader()
+{
+	Close();
+}
+
+bool FrameLogReader::Open( const std::string& filename )
+{
+	Close();
+
+#ifdef _WIN32
+	HANDLE file{ CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+							 OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL) };
+	if ( file == INVALID_HANDLE_VALUE ) return false;
+	LARGE_INTEGER filesize;
+	GetFileSizeEx( file, &filesize );
+	HANDLE mapping{ CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) };
+	if ( mapping == NULL ) {
+		CloseHandle( file );
+		return false;
+	}
+	void* view{ MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) };
+	if ( view == NULL ) {
+		CloseHandle( mapping );
+		CloseHandle( file );
+		return false;
+	}
+	filehandle_ = file;
+	mappinghandle_ = mapping;
+	mapping_ = static_cast<const uchar*>(view);
+	mappingsize_ = filesize.QuadPart;
+#else
+	int file{ open(filename.c_str(), O_RDONLY) };
+	if ( file < 0 ) return false;
+	struct stat filestat;
+	if ( (fstat(file, &filestat) != 0) || (filestat.st_size == 0) ) {
+		close( file );
+		return false;
+	}
+	void* view{ mmap(nullptr, filestat.st_size, PROT_READ, MAP_SHARED, file, 0) };
+	close( file );
+	if ( view == MAP_FAILED ) return false;
+	mapping_ = static_cast<const uchar*>(view);
+	mappingsize_ = filestat.st_size;
+#endif
+
+	//Validate header
+	if ( mappingsize_ < sizeof(FrameLogHeader) ) {
+		Close();
+		return false;
+	}
+	std::memcpy( &header_, mapping_, sizeof(header_) );
+	uint64_t offset{ sizeof(FrameLogHeader) + FileStartsBytes(header_.filecount) };
+	if ( (std::memcmp(header_.magic, k_logmagic, sizeof(k_logmagic)) != 0) ||
+		 (header_.version != k_logversion) ||
+		 (mappingsize_ < offset) ) {
+		Close();
+		return false;
+	}
+	const uint32_t* filestarts{ reinterpret_cast<const uint32_t*>(mapping_ +
+																  sizeof(FrameLogHeader)) };
+	filestarts_.assign( filestarts, filestarts + header_.filecount );
+
+	//Walk the segments up to the first one that isn't complete
+	std::map<uint64_t, uint64_t> iterationoffsets;
+	while ( (offset + sizeof(FrameLogSegment)) <= mappingsize_ ) {
+		const FrameLogSegment& segment{ *reinterpret_cast<const FrameLogSegment*>(mapping_ +
+																				 offset) };
+		uint64_t fixedbytes{ FixedSegmentBytes(segment, header_.valuecount) };
+		if ( (segment.blockcount != (segment.rowcount + k_logblockrows - 1) / k_logblockrows) ||
+			 (segment.bytes < fixedbytes) ||
+			 ((segment.bytes % 8) != 0) ||
+			 (segment.bytes > (mappingsize_ - offset)) ) break;
+		const FrameLogBlock* blocks{ reinterpret_cast<const FrameLogBlock*>(mapping_ +
+			offset + sizeof(FrameLogSegment) + header_.valuecount * sizeof(double)) };
+		uint64_t wordcount{ (segment.bytes - fixedbytes) / 8 };
+		bool valid{true};
+		for ( uint32_t b = 0; valid && (b < segment.blockcount); b++ ) {
+			uint32_t count{ std::min(k_logblockrows, segment.rowcount - b * k_logblockrows) };
+			for ( int c = 0; c < k_logcolumns; c++ ) {
+				const FrameLogBlock& block{ blocks[b * k_logcolumns + c] };
+				if ( (block.bitwidth > 32) ||
+					 (block.offset + PackedWords(count, block.bitwidth) > wordcount) ) {
+					valid = false;
+					break;
+				}
+			}
+		}
+		if ( !valid ) break;
+		iterationoffsets[segment.iteration] = offset;
+		offset += segment.bytes;
+	}
+	validbytes_ = offset;
+	for ( const std::pair<const uint64_t, uint64_t>& iterationoffset : iterationoffsets ) {
+		segmentoffsets_.push_back( iterationoffset.second );
+	}
+
+	return true;
+}
+
+void FrameLogReader::Close()
+{
+	segmentoffsets_.clear();
+	filestarts_.clear();
+	validbytes_ = 0;
+	if ( mapping_ == nullptr ) return;
+#ifdef _WIN32
+	UnmapViewOfFile( mapping_ );
+	CloseHandle( mappinghandle_ );
+	CloseHandle( filehandle_ );
+#else
+	munmap( const_cast<uchar*>(mapping_), mappingsize_ );
+#endif
+	mapping_ = nullptr;
+	mappingsize_ = 0;
+	std::memset( &header_, 0, sizeof(header_) );
+
+	return;
+}
+
+size_t FrameLogReader::SegmentCount() const
+{
+	return segmentoffsets_.size();
+}
+
+const FrameLogSegment& FrameLogReader::Segment( size_t index ) const
+{
+	return *reinterpret_cast<const FrameLogSegment*>(mapping_ + segmentoffsets_[index]);
+}
+
+const double* FrameLogReader::Values( size_t index ) const
+{
+	return reinterpret_cast<const double*>(mapping_ + segmentoffsets_[index] +
+										   sizeof(FrameLogSegment));
+}
+
+void FrameLogReader::Column( size_t index,
+							 int column,
+							 std::vector<uint32_t>& values ) const
+{
+	//Only this column's blocks are touched, the rest of the segment isn't paged in
+	const FrameLogSegment& segment{ Segment(index) };
+	const FrameLogBlock* blocks{ reinterpret_cast<const FrameLogBlock*>(Values(index) +
+																		header_.valuecount) };
+	const uint64_t* words{ reinterpret_cast<const uint64_t*>(blocks +
+		static_cast<uint64_t>(segment.blockcount) * k_logcolumns) };
+	values.resize( segment.rowcount );
+	for ( uint32_t b = 0; b < segment.blockcount; b++ ) {
+		uint32_t first{ b * k_logblockrows };
+		uint32_t count{ std::min(k_logblockrows, segment.rowcount - first) };
+		Unpack( words, blocks[b * k_logcolumns + column], count, values.data() + first );
+	}
+	return;
+}
+
+void FrameLogReader::Rows( size_t index,
+						   std::vector<FrameResult>& rows ) const
+{
+	std::vector< std::vector<uint32_t> > columns( k_logcolumns );
+	for ( int c = 0; c < k_logcolumns; c++ ) {
+		Column( index, c, columns[c] );
+	}
+	rows.resize( Segment(index).rowcount );
+	for ( uint32_t r = 0; r < rows.size(); r++ ) {
+		FrameResult& row{ rows[r] };
+		row.frame = columns[kFrameColumn][r];
+		row.detected = columns[kDetectedColumn][r] != 0;
+		row.match = 0.0f;
+		row.polygon.fill( cv::Point(0,0) );
+		if ( !row.detected ) continue;
+		row.match = MatchValue( columns[kMatchColumn][r] );
+		for ( int i = 0; i < 4; i++ ) {
+			row.polygon[i] = cv::Point(
+				static_cast<int>(columns[kPointColumn + 2 * i][r] ^ k_pointbias),
+				static_cast<int>(columns[kPointColumn + 2 * i + 1][r] ^ k_pointbias) );
+		}
+	}
+	return;
+}
+
+/*****************************************************************************************/
+FrameLogWriter::FrameLogWriter( const std::string& filename,
+								const FrameLogHeader& header,
+								const std::vector<uint32_t>& filestarts,
+								bool resume ):
+								failed_{false},
+								header_( header )
+{
+	std::memcpy( header_.magic, k_logmagic, sizeof(k_logmagic) );
+	header_.version = k_logversion;
+	header_.filecount = filestarts.size();
+
+	//Keep a log of the same run, cut back to its last complete segment
+	if ( resume ) {
+		uint64_t validbytes{0};
+		{
+			FrameLogReader reader;
+			if ( reader.Open(filename) &&
+				 (std::memcmp(&reader.header_, &header_, sizeof(header_)) == 0) &&
+				 (reader.filestarts_ == filestarts) ) validbytes = reader.validbytes_;
+		}
+		if ( (validbytes > 0) && Truncate(filename, validbytes) ) {
+			file_.open( filename, std::ios::binary | std::ios::app );
+			if ( !file_.is_open() ) failed_ = true;
+			return;
+		}
+	}
+
+	file_.open( filename, std::ios::binary | std::ios::trunc );
+	if ( !file_.is_open() ) {
+		failed_ = true;
+		return;
+	}
+	std::vector<char> filestartsbytes( FileStartsBytes(header_.filecount), 0 );
+	if ( !filestarts.empty() ) {
+		std::memcpy( filestartsbytes.data(),
+					 filestarts.data(),
+					 filestarts.size() * sizeof(uint32_t) );
+	}
+	file_.write( reinterpret_cast<const char*>(&header_), sizeof(header_) );
+	file_.write( filestartsbytes.data(), filestartsbytes.size() );
+	file_.flush();
+	if ( !file_ ) failed_ = true;
+}
+
+bool FrameLogWriter::Append( uint64_t iteration,
+							 const std::vector<double>& values,
+							 uint32_t scoredframes,
+							 int rung,
+							 std::vector<FrameResult>& rows )
+{
+	if ( failed_ || (values.size() != header_.valuecount) ) return false;
+
+	//Rows arrive a rung at a time, frame order keeps the frame column narrow
+	std::stable_sort( rows.begin(), rows.end(), []( const FrameResult& a, const FrameResult& b )
+					  { return a.frame < b.frame; } );
+	FrameLogSegment segment;
+	segment.iteration = iteration;
+	segment.rowcount = rows.size();
+	segment.blockcount = (segment.rowcount + k_logblockrows - 1) / k_logblockrows;
+	segment.scoredframes = scoredframes;
+	segment.rung = rung;
+
+	//Each column of a block is packed relative to its smallest value.  Columns only
+	//meaningful on detected rows take that value elsewhere, so undetected frames never
+	//widen a block.
+	std::vector<FrameLogBlock> blocks( static_cast<size_t>(segment.blockcount) * k_logcolumns );
+	std::vector<uint64_t> words;
+	uint32_t blockvalues[k_logblockrows];
+	for ( uint32_t b = 0; b < segment.blockcount; b++ ) {
+		uint32_t first{ b * k_logblockrows };
+		uint32_t count{ std::min(k_logblockrows, segment.rowcount - first) };
+		for ( int c = 0; c < k_logcolumns; c++ ) {
+			bool detectedonly{ c >= kMatchColumn };
+			uint32_t minimum{ UINT32_MAX };
+			uint32_t maximum{0};
+			for ( uint32_t i = 0; i < count; i++ ) {
+				if ( detectedonly && !rows[first + i].detected ) continue;
+				blockvalues[i] = ColumnValue( rows[first + i], c );
+				minimum = std::min( minimum, blockvalues[i] );
+				maximum = std::max( maximum, blockvalues[i] );
+			}
+			if ( minimum > maximum ) minimum = maximum = 0;
+			if ( detectedonly ) {
+				for ( uint32_t i = 0; i < count; i++ ) {
+					if ( !rows[first + i].detected ) blockvalues[i] = minimum;
+				}
+			}
+			FrameLogBlock& block{ blocks[b * k_logcolumns + c] };
+			block.reference = minimum;
+			block.bitwidth = BitWidth( maximum - minimum );
+			block.offset = words.size();
+			Pack( blockvalues, count, block, words );
+		}
+	}
+	segment.bytes = FixedSegmentBytes( segment, header_.valuecount ) +
+					words.size() * sizeof(uint64_t);
+
+	file_.write( reinterpret_cast<const char*>(&segment), sizeof(segment) );
+	file_.write( reinterpret_cast<const char*>(values.data()),
+				 values.size() * sizeof(double) );
+	file_.write( reinterpret_cast<const char*>(blocks.data()),
+				 blocks.size() * sizeof(FrameLogBlock) );
+	file_.write( reinterpret_cast<const char*>(words.data()),
+				 words.size() * sizeof(uint64_t) );
+	file_.flush();
+	if ( !file_ ) failed_ = true;
+
+	return !failed_;
+}
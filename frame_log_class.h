@@ -0,0 +1,125 @@
+#ifndef FRAMELOG_H
+#define FRAMELOG_H
+
+#include <string>
+#include <fstream>
+#include <vector>
+#include <cstdint>
+#include "opencv2/opencv.hpp"
+#include "result_values_class.h"
+
+//Columns of every segment, one row per evaluated frame in frame order.  Match and the
+//polygon corners only mean something on detected rows.  Match is stored in hundredths
+//of a percent, MatchValue turns it back.
+enum FrameLogColumn {
+	kFrameColumn,
+	kDetectedColumn,
+	kMatchColumn,
+	kPointColumn		//x then y of each of the 4 corners
+};
+const int k_logcolumns{ kPointColumn + 8 };
+const float k_logmatchscale{ 100.0f };
+
+inline float MatchValue( uint32_t value )
+{
+	return value / k_logmatchscale;
+}
+
+//Rows per block, each column of a block is packed at the bit width its range needs
+const uint32_t k_logblockrows{ 1024 };
+
+//On disk layout, filecount uint32 start frames padded to 8 bytes follow the header,
+//then the segments
+struct FrameLogHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t valuecount;
+	uint32_t totalframes;
+	uint32_t filecount;
+	int32_t framewidth;
+	int32_t frameheight;
+	int32_t optimalpolygon[8];	//Target of unlabelled frames
+	uint64_t runhash;
+	uint64_t labelhash;			//Zero unless some frames were matched against labels
+};
+
+//One evaluated candidate.  valuecount doubles follow, then blockcount * k_logcolumns
+//FrameLogBlock, then the packed words.
+struct FrameLogSegment {
+	uint64_t iteration;
+	uint64_t bytes;				//Whole segment, this header included
+	uint32_t rowcount;
+	uint32_t blockcount;
+	uint32_t scoredframes;		//Frames the results file scored it over
+	int32_t rung;
+};
+
+//Column values of a block are reference plus bitwidth bits each, starting at offset
+//64 bit words into the segment's packed words
+struct FrameLogBlock {
+	uint32_t reference;
+	uint32_t bitwidth;
+	uint64_t offset;
+};
+
+//Read only memory mapped frame log.  Segments are read in file order, a later segment
+//for an iteration replaces an earlier one, and a partly written segment at the end
+//is ignored.
+class FrameLogReader
+{
+	public:
+		FrameLogReader();
+		~FrameLogReader();
+		bool Open( const std::string& filename );
+		void Close();
+		size_t SegmentCount() const;
+		const FrameLogSegment& Segment( size_t index ) const;
+		const double* Values( size_t index ) const;
+		void Column( size_t index,
+					 int column,
+					 std::vector<uint32_t>& values ) const;
+		void Rows( size_t index,
+				   std::vector<FrameResult>& rows ) const;
+		FrameLogHeader header_;
+		std::vector<uint32_t> filestarts_;
+		uint64_t validbytes_;
+
+	protected:
+
+	private:
+		FrameLogReader( const FrameLogReader& ) = delete;
+		FrameLogReader& operator=( const FrameLogReader& ) = delete;
+		const uchar* mapping_;
+		uint64_t mappingsize_;
+		std::vector<uint64_t> segmentoffsets_;
+#ifdef _WIN32
+		void* filehandle_;
+		void* mappinghandle_;
+#endif
+};
+
+//Appends a segment per evaluated candidate, flushed as it goes so a killed run loses
+//at most the one being written.  When resuming, an existing log of the same run is
+//kept and appended to, anything else is started over.
+class FrameLogWriter
+{
+	public:
+		FrameLogWriter( const std::string& filename,
+						const FrameLogHeader& header,
+						const std::vector<uint32_t>& filestarts,
+						bool resume );
+		bool Append( uint64_t iteration,
+					 const std::vector<double>& values,
+					 uint32_t scoredframes,
+					 int rung,
+					 std::vector<FrameResult>& rows );
+		bool failed_;
+
+	protected:
+
+	private:
+		std::ofstream file_;
+		FrameLogHeader header_;
+};
+
+#endif // FRAMELOG_H
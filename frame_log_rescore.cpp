@@ -0,0 +1,199 @@
+//Re-scores the iterations of a frame log written by main --framelog, without running
+//the pipeline again.  Only the columns a score needs are unpacked.
+//
+//    frame_log_rescore logfile [--iteration=N] [--multiplier=X] [--minmatch=M]
+//                      [--clipweights=w1,w2,...] [--metric=match|corners]
+//
+//  --multiplier   weight of percent detected against average match, default 0.10
+//  --minmatch     detected frames matching less than M percent count as not detected
+//  --clipweights  score each file separately and average with these weights
+//  --metric       match is the stored overlap over union, corners is 100 less the
+//                 average corner distance to the target in percent of frame width.
+//                 Only the default target is logged, so corners needs an unlabelled run.
+
+//Standard libraries
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+#include <math.h>
+
+//3rd party libraries
+#include "opencv2/opencv.hpp"
+
+//Project headers
+#include "frame_log_class.h"
+
+/*****************************************************************************************/
+int main(int argc,char *argv[])
+{
+	//Split arguments into options and log file
+	std::string filename;
+	int64_t iteration{-1};
+	double multiplier{0.10};
+	double minmatch{0.0};
+	std::vector<double> clipweights;
+	bool cornermetric{false};
+	for (int i = 1; i < argc; i++ ) {
+		std::string argument{ argv[i] };
+		if ( argument.compare(0, 12, "--iteration=") == 0 ) {
+			iteration = std::stoll( argument.substr(12) );
+		} else if ( argument.compare(0, 13, "--multiplier=") == 0 ) {
+			multiplier = std::stod( argument.substr(13) );
+		} else if ( argument.compare(0, 11, "--minmatch=") == 0 ) {
+			minmatch = std::stod( argument.substr(11) );
+		} else if ( argument.compare(0, 14, "--clipweights=") == 0 ) {
+			std::istringstream weights( argument.substr(14) );
+			std::string weight;
+			while ( std::getline(weights, weight, ',') ) {
+				clipweights.push_back( std::stod(weight) );
+			}
+		} else if ( argument == "--metric=corners" ) {
+			cornermetric = true;
+		} else if ( argument == "--metric=match" ) {
+			cornermetric = false;
+		} else {
+			filename = argument;
+		}
+	}
+
+	FrameLogReader reader;
+	if ( filename.empty() || !reader.Open(filename) ) {
+		std::cout << "No frame log to rescore" << std::endl;
+		return 1;
+	}
+	const FrameLogHeader& header{ reader.header_ };
+	if ( !clipweights.empty() && (clipweights.size() != header.filecount) ) {
+		std::cout << "Expected " << header.filecount << " clip weights" << std::endl;
+		return 1;
+	}
+	if ( cornermetric && (header.labelhash != 0) ) {
+		std::cout << "Run was matched against labels, only --metric=match applies" << std::endl;
+		return 1;
+	}
+	std::cout << reader.SegmentCount() << " iterations, " << header.filecount << " files, "
+			  << header.totalframes << " total frames" << std::endl;
+
+	std::chrono::high_resolution_clock::time_point starttime{
+		std::chrono::high_resolution_clock::now() };
+	std::vector<uint32_t> frames;
+	std::vector<uint32_t> detected;
+	std::vector<uint32_t> matches;
+	std::vector<FrameResult> rows;
+	std::vector<int> clips;
+	int64_t bestiteration{-1};
+	int bestrung{0};
+	double bestscore{0.0};
+	uint64_t rowcount{0};
+	std::cout << std::fixed;
+	for ( size_t s = 0; s < reader.SegmentCount(); s++ ) {
+		const FrameLogSegment& segment{ reader.Segment(s) };
+		if ( (iteration >= 0) && (segment.iteration != iteration) ) continue;
+		rowcount += segment.rowcount;
+
+		//Per frame match under the chosen metric, negative if not detected
+		std::vector<double> framematches( segment.rowcount, -1.0 );
+		reader.Column( s, kDetectedColumn, detected );
+		if ( cornermetric ) {
+			reader.Rows( s, rows );
+			for ( uint32_t r = 0; r < segment.rowcount; r++ ) {
+				if ( !rows[r].detected ) continue;
+				double distance{0.0};
+				for ( int i = 0; i < 4; i++ ) {
+					distance += hypot( rows[r].polygon[i].x - header.optimalpolygon[2 * i],
+									   rows[r].polygon[i].y - header.optimalpolygon[2 * i + 1] );
+				}
+				framematches[r] = std::max( 100.0 - (25.0 * distance) / header.framewidth,
+											0.0 );
+			}
+		} else {
+			reader.Column( s, kMatchColumn, matches );
+			for ( uint32_t r = 0; r < segment.rowcount; r++ ) {
+				if ( detected[r] == 0 ) continue;
+				framematches[r] = MatchValue( matches[r] );
+			}
+		}
+		for ( double& match : framematches ) {
+			if ( (match >= 0.0) && (match < minmatch) ) match = -1.0;
+		}
+
+		//File of every row, only needed to weight clips
+		int clipcount{ clipweights.empty() ? 1 : static_cast<int>(header.filecount) };
+		clips.assign( segment.rowcount, 0 );
+		if ( !clipweights.empty() ) {
+			reader.Column( s, kFrameColumn, frames );
+			for ( uint32_t r = 0; r < segment.rowcount; r++ ) {
+				clips[r] = static_cast<int>( std::upper_bound(reader.filestarts_.begin(),
+															  reader.filestarts_.end(),
+															  frames[r]) -
+											 reader.filestarts_.begin() ) - 1;
+			}
+		}
+		std::vector<uint32_t> clipframes( clipcount, 0 );
+		std::vector<uint32_t> clipdetected( clipcount, 0 );
+		std::vector<double> clipmatch( clipcount, 0.0 );
+		for ( uint32_t r = 0; r < segment.rowcount; r++ ) {
+			int clip{ std::max(clips[r], 0) };
+			clipframes[clip]++;
+			if ( framematches[r] < 0.0 ) continue;
+			clipdetected[clip]++;
+			clipmatch[clip] += framematches[r];
+		}
+
+		//Same weighting as ResultValues, over the frames the results file used unless
+		//clips are weighted
+		double score{0.0};
+		double weightsum{0.0};
+		uint32_t totaldetected{0};
+		double totalmatch{0.0};
+		for ( int c = 0; c < clipcount; c++ ) {
+			totaldetected += clipdetected[c];
+			totalmatch += clipmatch[c];
+			uint32_t scoredframes{ clipweights.empty() ? segment.scoredframes : clipframes[c] };
+			if ( scoredframes == 0 ) continue;
+			double averagematch{ (clipdetected[c] > 0) ? clipmatch[c] / clipdetected[c] : 0.0 };
+			double weight{ clipweights.empty() ? 1.0 : clipweights[c] };
+			score += weight * ( multiplier * ((100.0 * clipdetected[c]) / scoredframes) +
+								(1.0 - multiplier) * averagematch );
+			weightsum += weight;
+		}
+		if ( weightsum > 0.0 ) score /= weightsum;
+		
+		//Candidates halving dropped were only scored on a subset, same rule as the
+		//optimizer, they can't be best unless asked for by iteration
+		bool complete{ segment.scoredframes == header.totalframes };
+		if ( (complete || (iteration >= 0)) && ((bestiteration < 0) || (score > bestscore)) ) {
+			bestiteration = segment.iteration;
+			bestrung = segment.rung;
+			bestscore = score;
+		}
+
+		std::cout << "Iteration " << segment.iteration << ", rung " << segment.rung << ", "
+				  << std::setprecision(4);
+		const double* values{ reader.Values(s) };
+		for ( uint32_t j = 0; j < header.valuecount; j++ ) {
+			std::cout << values[j] << ",";
+		}
+		std::cout << " " << totaldetected << " of " << segment.rowcount << " detected"
+				  << ", average match "
+				  << ((totaldetected > 0) ? totalmatch / totaldetected : 0.0)
+				  << std::setprecision(2) << ", score " << score << std::endl;
+	}
+	double runtime{ std::chrono::duration_cast<std::chrono::microseconds>
+		(std::chrono::high_resolution_clock::now() - starttime).count() / 1000.0 };
+
+	if ( bestiteration < 0 ) {
+		std::cout << "No complete iterations to rescore, name one with --iteration"
+				  << std::endl;
+		return 1;
+	}
+	std::cout << "Best iteration " << bestiteration << ", rung " << bestrung << ", score "
+			  << bestscore << std::endl;
+	std::cout << std::setprecision(1) << "Rescored " << rowcount << " frames in "
+			  << runtime << " ms" << std::endl;
+
+	return 0;
+}
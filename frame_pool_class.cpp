@@ -0,0 +1,43 @@
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include "opencv2/opencv.hpp"
+#include "frame_pool_class.h"
+
+FramePool::FramePool( int buffercount,
+					  cv::Size framesize,
+					  int frametype ):
+					  buffers_( buffercount )
+{
+	for ( int i = 0; i < buffercount; i++ ) {
+		buffers_[i].create( framesize, frametype );
+		freebuffers_.push_back( i );
+	}
+}
+
+int FramePool::Acquire()
+{
+	std::unique_lock<std::mutex> lock( mutex_ );
+	released_.wait( lock, [this]{ return !freebuffers_.empty(); } );
+	int index{ freebuffers_.back() };
+	freebuffers_.pop_back();
+
+	return index;
+}
+
+cv::Mat& FramePool::Buffer( int index )
+{
+	//Only the holder of index may touch the buffer, so no lock needed
+	return buffers_[index];
+}
+
+void FramePool::Release( int index )
+{
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		freebuffers_.push_back( index );
+	}
+	released_.notify_one();
+
+	return;
+}
@@ -0,0 +1,33 @@
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include "opencv2/opencv.hpp"
+
+//Fixed set of preallocated frame buffers.  The decoder acquires a buffer, decodes into
+//it and passes its index along with the frame, the consumer releases it once done.  In
+//steady state no frame memory is allocated.
+class FramePool
+{
+	public:
+		FramePool( int buffercount,
+				   cv::Size framesize,
+				   int frametype );
+		int Acquire();
+		cv::Mat& Buffer( int index );
+		void Release( int index );
+
+	protected:
+
+	private:
+		FramePool( const FramePool& ) = delete;
+		FramePool& operator=( const FramePool& ) = delete;
+		std::vector<cv::Mat> buffers_;
+		std::vector<int> freebuffers_;
+		std::mutex mutex_;
+		std::condition_variable released_;
+};
+
+#endif // FRAMEPOOL_H
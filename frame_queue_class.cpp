@@ -0,0 +1,101 @@
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include "opencv2/opencv.hpp"
+#include "frame_queue_class.h"
+
+FrameQueue::FrameQueue( size_t slotcount,
+						uint64_t capacitybytes ):
+						slots_( slotcount ),
+						slotbytes_( slotcount, 0 ),
+						slotbuffers_( slotcount, -1 ),
+						capacitybytes_{ capacitybytes },
+						head_{0},
+						tail_{0},
+						queuedbytes_{0},
+						closed_{false},
+						producerwaiting_{false},
+						consumerwaiting_{false}
+{
+}
+
+void FrameQueue::Push( const cv::Mat& frame,
+					   int bufferindex )
+{
+	uint64_t framebytes{ frame.total() * frame.elemSize() };
+
+	//Block while full, waiter flag is set before the final check so no wake is lost
+	if ( !CanPush(framebytes) ) {
+		std::unique_lock<std::mutex> lock( mutex_ );
+		producerwaiting_ = true;
+		notfull_.wait( lock, [this, framebytes]{ return CanPush(framebytes); } );
+		producerwaiting_ = false;
+	}
+
+	size_t tail{ tail_.load(std::memory_order_relaxed) };
+	slots_[tail % slots_.size()] = frame;
+	slotbytes_[tail % slots_.size()] = framebytes;
+	slotbuffers_[tail % slots_.size()] = bufferindex;
+	queuedbytes_ += framebytes;
+	tail_.store( tail + 1 );
+	Wake( consumerwaiting_, notempty_ );
+
+	return;
+}
+
+bool FrameQueue::Pop( cv::Mat& frame,
+					  int* bufferindex )
+{
+	auto available = [this]{ return (tail_.load() != head_.load(std::memory_order_relaxed)) ||
+									closed_.load(); };
+	if ( !available() ) {
+		std::unique_lock<std::mutex> lock( mutex_ );
+		consumerwaiting_ = true;
+		notempty_.wait( lock, available );
+		consumerwaiting_ = false;
+	}
+
+	//Closed and drained
+	size_t head{ head_.load(std::memory_order_relaxed) };
+	if ( tail_.load() == head ) return false;
+
+	cv::Mat& slot{ slots_[head % slots_.size()] };
+	frame = slot;
+	slot.release();
+	if ( bufferindex != nullptr ) *bufferindex = slotbuffers_[head % slots_.size()];
+	queuedbytes_ -= slotbytes_[head % slots_.size()];
+	head_.store( head + 1 );
+	Wake( producerwaiting_, notfull_ );
+
+	return true;
+}
+
+void FrameQueue::Close()
+{
+	closed_ = true;
+	Wake( consumerwaiting_, notempty_ );
+	return;
+}
+
+bool FrameQueue::CanPush( uint64_t framebytes ) const
+{
+	size_t head{ head_.load() };
+	size_t tail{ tail_.load(std::memory_order_relaxed) };
+	if ( (tail - head) >= slots_.size() ) return false;
+
+	//A single frame larger than the byte capacity is still let through on its own
+	if ( tail == head ) return true;
+	return (queuedbytes_.load() + framebytes) <= capacitybytes_;
+}
+
+void FrameQueue::Wake( std::atomic<bool>& waiting,
+					   std::condition_variable& condition )
+{
+	//Only touch the mutex when the other side is actually asleep
+	if ( waiting.load() ) {
+		std::lock_guard<std::mutex> lock( mutex_ );
+		condition.notify_one();
+	}
+	return;
+}
@@ -0,0 +1,48 @@
+#ifndef FRAMEQUEUE_H
+#define FRAMEQUEUE_H
+
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include "opencv2/opencv.hpp"
+
+//Bounded single producer/single consumer ring of frames.  Push and Pop are lock free
+//while the ring is neither full nor empty, and otherwise block without spinning.  The
+//bound is both a slot count and a total number of queued bytes.  Each frame may carry
+//the index of the FramePool buffer it lives in.
+class FrameQueue
+{
+	public:
+		FrameQueue( size_t slotcount,
+					uint64_t capacitybytes );
+		void Push( const cv::Mat& frame,
+				   int bufferindex = -1 );
+		bool Pop( cv::Mat& frame,
+				  int* bufferindex = nullptr );
+		void Close();
+
+	protected:
+
+	private:
+		FrameQueue( const FrameQueue& ) = delete;
+		FrameQueue& operator=( const FrameQueue& ) = delete;
+		bool CanPush( uint64_t framebytes ) const;
+		void Wake( std::atomic<bool>& waiting,
+				   std::condition_variable& condition );
+		std::vector<cv::Mat> slots_;
+		std::vector<uint64_t> slotbytes_;
+		std::vector<int> slotbuffers_;
+		uint64_t capacitybytes_;
+		std::atomic<size_t> head_;
+		std::atomic<size_t> tail_;
+		std::atomic<uint64_t> queuedbytes_;
+		std::atomic<bool> closed_;
+		std::atomic<bool> producerwaiting_;
+		std::atomic<bool> consumerwaiting_;
+		std::mutex mutex_;
+		std::condition_variable notfull_;
+		std::condition_variable notempty_;
+};
+
+#endif // FRAMEQUEUE_H
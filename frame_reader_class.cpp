@@ -0,0 +1,143 @@
+#include <iostream>
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include <cctype>
+#include "opencv2/opencv.hpp"
+#include "frame_reader_class.h"
+
+namespace {
+	//Bytes of chroma after the luma plane, NV12 interleaves U and V in one half height
+	//plane while I420 stores them as two quarter size planes
+	uint64_t ChromaBytes( const RawVideoFormat& rawformat )
+	{
+		uint64_t width{ static_cast<uint64_t>(rawformat.framesize.width) };
+		uint64_t height{ static_cast<uint64_t>(rawformat.framesize.height) };
+		switch ( rawformat.format ) {
+			case YuvFormat::kNv12:
+				return width * (height / 2);
+			case YuvFormat::kI420:
+				return 2 * (width / 2) * (height / 2);
+		}
+		return 0;
+	}
+}
+
+FrameReader::FrameReader( const std::string& filename,
+						  const RawVideoFormat& rawformat ):
+						  raw_{ IsRawFile(filename) },
+						  rawformat_( rawformat ),
+						  framecount_{0}
+{
+	if ( !raw_ ) {
+		capture_.open( filename );
+		if ( capture_.isOpened() ) {
+			framecount_ = static_cast<int>( capture_.get(cv::CAP_PROP_FRAME_COUNT) );
+		}
+		return;
+	}
+	
+	//Frame count follows from the file size, the size has to be given
+	if ( rawformat_.framesize.area() <= 0 ) {
+		std::cout << filename << " needs --yuvsize=WxH to be read" << std::endl;
+		return;
+	}
+	
+	//Chroma is subsampled in both directions, odd sizes can't be 4:2:0
+	if ( (rawformat_.framesize.width % 2 != 0) || (rawformat_.framesize.height % 2 != 0) ) {
+		std::cout << filename << " can't be " << rawformat_.framesize.width << "x"
+				  << rawformat_.framesize.height << ", 4:2:0 needs an even width and height"
+				  << std::endl;
+		return;
+	}
+	rawfile_.open( filename, std::ios::binary | std::ios::ate );
+	if ( !rawfile_.is_open() ) return;
+	uint64_t filebytes{ static_cast<uint64_t>(rawfile_.tellg()) };
+	uint64_t framebytes{ static_cast<uint64_t>(rawformat_.framesize.area()) +
+						 ChromaBytes(rawformat_) };
+	framecount_ = static_cast<int>( filebytes / framebytes );
+	if ( (filebytes % framebytes) != 0 ) {
+		std::cout << filename << " ends in a partial frame, check --yuvsize and --yuvformat"
+				  << std::endl;
+	}
+	rawfile_.seekg( 0 );
+}
+
+bool FrameReader::IsOpened() const
+{
+	return raw_ ? rawfile_.is_open() && (framecount_ > 0) : capture_.isOpened();
+}
+
+int FrameReader::FrameCount() const
+{
+	return framecount_;
+}
+
+int FrameReader::ReadableFrames() const
+{
+	//A raw count is exact, VideoCapture's may be one past what decodes
+	return raw_ ? framecount_ : std::max( framecount_ - 1, 0 );
+}
+
+cv::Size FrameReader::FrameSize() const
+{
+	if ( raw_ ) return rawformat_.framesize;
+	return cv::Size( capture_.get(cv::CAP_PROP_FRAME_WIDTH),
+					 capture_.get(cv::CAP_PROP_FRAME_HEIGHT) );
+}
+
+int FrameReader::FrameType() const
+{
+	return raw_ ? CV_8UC1 : CV_8UC3;
+}
+
+bool FrameReader::Read( cv::Mat& frame )
+{
+	if ( !raw_ ) {
+		capture_ >> frame;
+		return !frame.empty();
+	}
+	
+	//Luma rows straight into the frame, chroma skipped since only gray is used
+	frame.create( rawformat_.framesize, CV_8UC1 );
+	for ( int i = 0; i < frame.rows; i++ ) {
+		rawfile_.read( reinterpret_cast<char*>(frame.ptr<uchar>(i)), frame.cols );
+	}
+	rawfile_.seekg( static_cast<std::streamoff>(ChromaBytes(rawformat_)), std::ios::cur );
+	if ( !rawfile_ ) {
+		frame.release();
+		return false;
+	}
+	return true;
+}
+
+void FrameReader::Release()
+{
+	if ( raw_ ) {
+		rawfile_.close();
+	} else {
+		capture_.release();
+	}
+	return;
+}
+
+bool FrameReader::IsRawFile( const std::string& filename )
+{
+	if ( filename.size() < 4 ) return false;
+	std::string extension{ filename.substr(filename.size() - 4) };
+	std::transform( extension.begin(), extension.end(), extension.begin(), ::tolower );
+	return extension == ".yuv";
+}
+
+bool FrameReader::ParseYuvFormat( const std::string& name,
+								  YuvFormat& format )
+{
+	if ( name == "nv12" ) {
+		format = YuvFormat::kNv12;
+	} else if ( name == "i420" ) {
+		format = YuvFormat::kI420;
+	} else {
+		return false;
+	}
+	return true;
+}
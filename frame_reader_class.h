@@ -0,0 +1,52 @@
+#ifndef FRAMEREADER_H
+#define FRAMEREADER_H
+
+#include <string>
+#include <fstream>
+#include "opencv2/opencv.hpp"
+
+//Planar 4:2:0 layouts of raw .yuv dumps.  Both store the full luma plane first, then
+//NV12 one interleaved UV plane and I420 separate U and V planes.
+enum class YuvFormat {
+	kNv12,
+	kI420
+};
+
+//How to read .yuv files, which carry no header of their own
+struct RawVideoFormat {
+	cv::Size framesize;
+	YuvFormat format;
+};
+
+//Reads frames either through VideoCapture or, for .yuv files, straight from the luma
+//plane of a raw dump with no color conversion at all.  Video frames come out BGR and
+//raw frames gray, PreprocessImage takes either.
+class FrameReader
+{
+	public:
+		FrameReader( const std::string& filename,
+					 const RawVideoFormat& rawformat );
+		bool IsOpened() const;
+		int FrameCount() const;
+		int ReadableFrames() const;
+		cv::Size FrameSize() const;
+		int FrameType() const;
+		bool Read( cv::Mat& frame );
+		void Release();
+		static bool IsRawFile( const std::string& filename );
+		static bool ParseYuvFormat( const std::string& name,
+									YuvFormat& format );
+
+	protected:
+
+	private:
+		FrameReader( const FrameReader& ) = delete;
+		FrameReader& operator=( const FrameReader& ) = delete;
+		bool raw_;
+		cv::VideoCapture capture_;
+		std::ifstream rawfile_;
+		RawVideoFormat rawformat_;
+		int framecount_;
+};
+
+#endif // FRAMEREADER_H
@@ -0,0 +1,244 @@
+#include <string>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <vector>
+#include "opencv2/opencv.hpp"
+#include "frame_store_class.h"
+
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+namespace {
+	const char k_storemagic[8]{ 'L', 'D', 'F', 'S', 'T', 'O', 'R', 'E' };
+	const uint32_t k_storeversion{ 2 };
+	const uint64_t k_storealignment{ 4096 };		//Keeps frame data page aligned
+
+	//Blocks of the source sampled into its hash
+	const int k_hashblocks{ 16 };
+	const uint64_t k_hashblockbytes{ 64 * 1024 };
+}
+
+FrameStore::FrameStore():
+						mapping_{nullptr},
+						mappingsize_{0}
+#ifdef _WIN32
+						, filehandle_{nullptr},
+						mappinghandle_{nullptr}
+#endif
+{
+	std::memset( &header_, 0, sizeof(header_) );
+}
+
+FrameStore::~FrameStore()
+{
+	Close();
+}
+
+bool FrameStore::Open( const std::string& storefilename,
+					   uint64_t sourcehash )
+{
+	Close();
+
+#ifdef _WIN32
+	HANDLE file{ CreateFileA(storefilename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+							 OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL) };
+	if ( file == INVALID_HANDLE_VALUE ) return false;
+	LARGE_INTEGER filesize;
+	GetFileSizeEx( file, &filesize );
+	HANDLE mapping{ CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) };
+	if ( mapping == NULL ) {
+		CloseHandle( file );
+		return false;
+	}
+	void* view{ MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) };
+	if ( view == NULL ) {
+		CloseHandle( mapping );
+		CloseHandle( file );
+		return false;
+	}
+	filehandle_ = file;
+	mappinghandle_ = mapping;
+	mapping_ = static_cast<const uchar*>(view);
+	mappingsize_ = filesize.QuadPart;
+#else
+	int file{ open(storefilename.c_str(), O_RDONLY) };
+	if ( file < 0 ) return false;
+	struct stat filestat;
+	if ( (fstat(file, &filestat) != 0) || (filestat.st_size == 0) ) {
+		close( file );
+		return false;
+	}
+	void* view{ mmap(nullptr, filestat.st_size, PROT_READ, MAP_SHARED, file, 0) };
+	close( file );
+	if ( view == MAP_FAILED ) return false;
+	mapping_ = static_cast<const uchar*>(view);
+	mappingsize_ = filestat.st_size;
+#endif
+
+	//Validate header against the source it was built from
+	if ( mappingsize_ < sizeof(FrameStoreHeader) ) {
+		Close();
+		return false;
+	}
+	std::memcpy( &header_, mapping_, sizeof(header_) );
+	uint64_t framebytes{ static_cast<uint64_t>(header_.width) * header_.height };
+	if ( (std::memcmp(header_.magic, k_storemagic, sizeof(k_storemagic)) != 0) ||
+		 (header_.version != k_storeversion) ||
+		 (header_.sourcehash != sourcehash) ||
+		 (mappingsize_ < header_.dataoffset + framebytes * header_.framecount) ) {
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void FrameStore::Close()
+{
+	if ( mapping_ == nullptr ) return;
+#ifdef _WIN32
+	UnmapViewOfFile( mapping_ );
+	CloseHandle( mappinghandle_ );
+	CloseHandle( filehandle_ );
+#else
+	munmap( const_cast<uchar*>(mapping_), mappingsize_ );
+#endif
+	mapping_ = nullptr;
+	mappingsize_ = 0;
+	std::memset( &header_, 0, sizeof(header_) );
+
+	return;
+}
+
+cv::Mat FrameStore::Frame( uint32_t index ) const
+{
+	//Mapping is read only, consumers must never write into the returned header
+	uint64_t framebytes{ static_cast<uint64_t>(header_.width) * header_.height };
+	uchar* data{ const_cast<uchar*>(mapping_ + header_.dataoffset + framebytes * index) };
+	return cv::Mat( header_.height, header_.width, CV_8UC1, data );
+}
+
+uint64_t FrameStore::HashFile( const std::string& filename )
+{
+	//Size and modification time, plus evenly spaced blocks of the contents so a file
+	//rewritten with the same size and time is still caught.  Reading the whole of a
+	//large video would cost as much as decoding it.
+	uint64_t filesize{0};
+	int64_t modifiedtime{0};
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if ( !GetFileAttributesExA(filename.c_str(), GetFileExInfoStandard, &attributes) ) {
+		return 0;
+	}
+	filesize = (static_cast<uint64_t>(attributes.nFileSizeHigh) << 32) |
+			   attributes.nFileSizeLow;
+	modifiedtime = (static_cast<int64_t>(attributes.ftLastWriteTime.dwHighDateTime) << 32) |
+				   attributes.ftLastWriteTime.dwLowDateTime;
+#else
+	struct stat filestat;
+	if ( stat(filename.c_str(), &filestat) != 0 ) return 0;
+	filesize = filestat.st_size;
+	modifiedtime = filestat.st_mtime;
+#endif
+	std::ifstream file( filename, std::ios::binary );
+	if ( !file.is_open() ) return 0;
+
+	//FNV-1a
+	uint64_t hash{ 14695981039346656037ULL };
+	auto hashbytes = [&hash]( const char* bytes, size_t count ) {
+		for ( size_t i = 0; i < count; i++ ) {
+			hash ^= static_cast<uchar>(bytes[i]);
+			hash *= 1099511628211ULL;
+		}
+	};
+	hashbytes( reinterpret_cast<const char*>(&filesize), sizeof(filesize) );
+	hashbytes( reinterpret_cast<const char*>(&modifiedtime), sizeof(modifiedtime) );
+	std::vector<char> buffer( k_hashblockbytes );
+	uint64_t lastoffset{ (filesize > k_hashblockbytes) ? filesize - k_hashblockbytes : 0 };
+	for ( int i = 0; i < k_hashblocks; i++ ) {
+		file.seekg( (lastoffset * i) / (k_hashblocks - 1) );
+		file.read( buffer.data(), buffer.size() );
+		hashbytes( buffer.data(), static_cast<size_t>(file.gcount()) );
+		file.clear();
+	}
+
+	return hash;
+}
+
+/*****************************************************************************************/
+FrameStoreWriter::FrameStoreWriter( const std::string& storefilename,
+									uint64_t sourcehash ):
+									storefilename_{ storefilename },
+									tempfilename_{ storefilename + ".tmp" },
+									file_{ storefilename + ".tmp",
+										   std::ios::binary | std::ios::trunc },
+									failed_{false}
+{
+	std::memset( &header_, 0, sizeof(header_) );
+	std::memcpy( header_.magic, k_storemagic, sizeof(k_storemagic) );
+	header_.version = k_storeversion;
+	header_.sourcehash = sourcehash;
+	header_.dataoffset = k_storealignment;
+	if ( !file_.is_open() ) {
+		failed_ = true;
+		return;
+	}
+
+	//Header is rewritten with final values by Finish()
+	std::vector<char> padding( header_.dataoffset, 0 );
+	file_.write( padding.data(), padding.size() );
+}
+
+bool FrameStoreWriter::Append( const cv::Mat& frame )
+{
+	if ( failed_ ) return false;
+	if ( header_.framecount == 0 ) {
+		header_.width = frame.cols;
+		header_.height = frame.rows;
+	}
+	if ( (frame.type() != CV_8UC1) ||
+		 (frame.cols != header_.width) ||
+		 (frame.rows != header_.height) ) {
+		failed_ = true;
+		return false;
+	}
+	for ( int i = 0; i < frame.rows; i++ ) {
+		file_.write( reinterpret_cast<const char*>(frame.ptr<uchar>(i)), frame.cols );
+	}
+	header_.framecount++;
+	if ( !file_ ) failed_ = true;
+
+	return !failed_;
+}
+
+bool FrameStoreWriter::Finish()
+{
+	if ( !failed_ ) {
+		file_.seekp( 0 );
+		file_.write( reinterpret_cast<const char*>(&header_), sizeof(header_) );
+		if ( !file_ ) failed_ = true;
+	}
+	file_.close();
+	if ( failed_ ) {
+		std::remove( tempfilename_.c_str() );
+		return false;
+	}
+
+	//Replace any stale store in one step, Windows rename won't overwrite
+#ifdef _WIN32
+	std::remove( storefilename_.c_str() );
+#endif
+	if ( std::rename(tempfilename_.c_str(), storefilename_.c_str()) != 0 ) {
+		std::remove( tempfilename_.c_str() );
+		return false;
+	}
+
+	return true;
+}
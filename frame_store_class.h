@@ -0,0 +1,67 @@
+#ifndef FRAMESTORE_H
+#define FRAMESTORE_H
+
+#include <string>
+#include <fstream>
+#include "opencv2/opencv.hpp"
+
+//On disk layout, frames follow the header at dataoffset, each width*height bytes
+struct FrameStoreHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint32_t framecount;
+	uint64_t sourcehash;			//Source file, and a raw file's size and layout
+	uint64_t dataoffset;
+};
+
+//Read only memory mapped store of grayscale+blurred frames for one video file.  Written
+//once on the first run, every later run maps it instead of decoding the video, and
+//processes sharing a store share its page cache.
+class FrameStore
+{
+	public:
+		FrameStore();
+		~FrameStore();
+		bool Open( const std::string& storefilename,
+				   uint64_t sourcehash );
+		void Close();
+		cv::Mat Frame( uint32_t index ) const;
+		static uint64_t HashFile( const std::string& filename );
+		FrameStoreHeader header_;
+
+	protected:
+
+	private:
+		FrameStore( const FrameStore& ) = delete;
+		FrameStore& operator=( const FrameStore& ) = delete;
+		const uchar* mapping_;
+		uint64_t mappingsize_;
+#ifdef _WIN32
+		void* filehandle_;
+		void* mappinghandle_;
+#endif
+};
+
+//Streams frames into a temporary file and renames it into place once complete, so a
+//reader never maps a partially written store
+class FrameStoreWriter
+{
+	public:
+		FrameStoreWriter( const std::string& storefilename,
+						  uint64_t sourcehash );
+		bool Append( const cv::Mat& frame );
+		bool Finish();
+
+	protected:
+
+	private:
+		std::string storefilename_;
+		std::string tempfilename_;
+		std::ofstream file_;
+		FrameStoreHeader header_;
+		bool failed_;
+};
+
+#endif // FRAMESTORE_H
@@ -0,0 +1,112 @@
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include "opencv2/opencv.hpp"
+#include "label_store_class.h"
+#include "lane_detect_processor.h"
+
+namespace {
+	struct Keyframe {
+		uint32_t frame;
+		Polygon polygon;
+	};
+
+	//FNV-1a, continued from hash
+	uint64_t HashValue( uint64_t hash,
+						int64_t value )
+	{
+		for ( int i = 0; i < 8; i++ ) {
+			hash ^= static_cast<uint64_t>(value >> (8 * i)) & 0xff;
+			hash *= 1099511628211ULL;
+		}
+		return hash;
+	}
+}
+
+LabelStore::LabelStore( uint32_t totalframes,
+						const Polygon& defaulttarget ):
+						labelledfiles_{0},
+						keyframes_{0},
+						hash_{ 14695981039346656037ULL },
+						targets_( totalframes, defaulttarget ),
+						defaulttarget_( defaulttarget )
+{
+}
+
+bool LabelStore::Load( const std::string& labelfilename,
+					   uint32_t filestart,
+					   uint32_t framecount )
+{
+	std::ifstream file( labelfilename );
+	if ( !file.is_open() ) return false;
+
+	//Whole file is parsed before any frame is touched, a bad line leaves the default
+	std::vector<Keyframe> keyframes;
+	std::string line;
+	while ( std::getline(file, line) ) {
+		size_t first{ line.find_first_not_of(" \t\r") };
+		if ( (first == std::string::npos) || (line[first] == '#') ) continue;
+		std::istringstream values( line );
+		Keyframe keyframe;
+		int64_t frame;
+		values >> frame;
+		for ( cv::Point& point : keyframe.polygon ) {
+			values >> point.x >> point.y;
+		}
+		if ( !values || (frame < 0) ) return false;
+		if ( frame >= framecount ) continue;
+		keyframe.frame = frame;
+		keyframes.push_back( keyframe );
+	}
+	if ( keyframes.empty() ) return false;
+	std::stable_sort( keyframes.begin(), keyframes.end(),
+					  []( const Keyframe& a, const Keyframe& b ) { return a.frame < b.frame; } );
+
+	//Hold the first and last keyframes out to the ends of the file
+	uint32_t lastframe{ std::min(filestart + framecount,
+								 static_cast<uint32_t>(targets_.size())) };
+	for ( uint32_t f = filestart; f < lastframe; f++ ) {
+		uint32_t frame{ f - filestart };
+		std::vector<Keyframe>::const_iterator next{
+			std::upper_bound(keyframes.begin(), keyframes.end(), frame,
+							 []( uint32_t value, const Keyframe& keyframe )
+							 { return value < keyframe.frame; }) };
+		if ( next == keyframes.begin() ) {
+			targets_[f] = next->polygon;
+		} else if ( next == keyframes.end() ) {
+			targets_[f] = keyframes.back().polygon;
+		} else {
+			const Keyframe& previous{ *(next - 1) };
+			double t{ static_cast<double>(frame - previous.frame) /
+					  (next->frame - previous.frame) };
+			for ( int i = 0; i < 4; i++ ) {
+				cv::Point2d point{ cv::Point2d(previous.polygon[i]) +
+								   (cv::Point2d(next->polygon[i]) -
+									cv::Point2d(previous.polygon[i])) * t };
+				targets_[f][i] = cv::Point( cvRound(point.x), cvRound(point.y) );
+			}
+		}
+	}
+
+	//Results depend on the labels, hashed into the run settings
+	hash_ = HashValue( hash_, filestart );
+	for ( const Keyframe& keyframe : keyframes ) {
+		hash_ = HashValue( hash_, keyframe.frame );
+		for ( const cv::Point& point : keyframe.polygon ) {
+			hash_ = HashValue( HashValue(hash_, point.x), point.y );
+		}
+	}
+	labelledfiles_++;
+	keyframes_ += keyframes.size();
+
+	return true;
+}
+
+const Polygon& LabelStore::Target( uint32_t frame ) const
+{
+	//Frames beyond what was counted up front keep the default
+	if ( frame >= targets_.size() ) return defaulttarget_;
+	return targets_[frame];
+}
@@ -0,0 +1,40 @@
+#ifndef LABELSTORE_H
+#define LABELSTORE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "opencv2/opencv.hpp"
+#include "lane_detect_processor.h"
+
+//Ground truth lane polygon of every frame, indexed by frame over all files.  Each video
+//may have a label file next to it, one keyframe per line:
+//
+//    frame x0 y0 x1 y1 x2 y2 x3 y3
+//
+//with frame counted from the start of that video and the corners in Polygon order,
+//bottom left, bottom right, top right, top left, in the video's pixels.  Frames between
+//keyframes are interpolated linearly, frames before the first or after the last hold
+//it, so labelling every frame is just a keyframe on every line.  Lines starting with #
+//are comments.  Frames of videos without a label file keep the default target.
+class LabelStore
+{
+	public:
+		LabelStore( uint32_t totalframes,
+					const Polygon& defaulttarget );
+		bool Load( const std::string& labelfilename,
+				   uint32_t filestart,
+				   uint32_t framecount );
+		const Polygon& Target( uint32_t frame ) const;
+		int labelledfiles_;
+		uint32_t keyframes_;
+		uint64_t hash_;
+
+	protected:
+
+	private:
+		std::vector<Polygon> targets_;
+		Polygon defaulttarget_;
+};
+
+#endif // LABELSTORE_H
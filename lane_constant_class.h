@@ -17,12 +17,12 @@ class LaneConstant
 		std::string variablename_;
 		double value_;
 		bool finished_;
+		double minvalue_;
+		double maxvalue_;
 	protected:
 
 	private:
 		void Reverse();
-		double minvalue_;
-		double maxvalue_;
 		double increment_;
 		double direction_;
 		double range_;
@@ -15,41 +15,76 @@
 #ifndef LANEDETECTCONSTANTS_H
 #define LANEDETECTCONSTANTS_H
 
-//Project libraries
-#include "lane_detect_processor.h"
+//Standard libraries
+#include <cstdint>
+#include <string>
 
 /*****************************************************************************************/
-namespace lanedetectconstants {
+//Frame size the constants are expressed in.  Marked constants are fractions of this
+//frame in its pixel units, and are scaled to the size of the image actually processed.
+const int k_referencewidth{ 800 };
+const int k_referenceheight{ 480 };
+
+//All tunable lane detect constants.  Passed by const reference to every processing
+//function so that several configurations can be evaluated at once.
+struct LaneDetectConstants {
+	
+	//Process at 1/k_downscale of the frame size, set once and never swept.  Polygons are
+	//mapped back to full resolution.
+	uint16_t k_downscale{ 1 };
 	
 	//Image evaluation
-	extern float k_contrastscalefactor;
+	float k_contrastscalefactor{ 0.3f };
+	
+	//Region of interest, set once and never swept.  Canny and findContours only see rows
+	//from k_roimargin above k_verticalsegmentlimit down, contour coordinates stay those of
+	//the full frame and image statistics still come from the full frame.  Canny's Sobel
+	//replicates the first cropped row instead of reading the rows above it, and edges
+	//can no longer link through the cut, so a contour crossing it is truncated there and
+	//its center, fitline and point count change.  Only segments centred below
+	//k_verticalsegmentlimit that reach more than the margin above it are affected.
+	bool k_useroi{ false };
+	uint16_t k_roimargin{ 20 };						//Scaled to image size
+	
+	//Tracking, set once and never swept.  LaneTracker searches only k_trackingbandwidth
+	//either side of each predicted lane line, and distrusts a lane whose corners are
+	//on average more than k_trackingmaxdeviation from the prediction.
+	uint16_t k_trackingbandwidth{ 40 };				//Scaled to image size
+	uint16_t k_trackingmaxdeviation{ 25 };			//Scaled to image size
 	
 	//Segment filtering
-	extern uint16_t k_segmentminimumsize;
-	extern uint16_t k_verticalsegmentlimit;
-	extern float k_maxvanishingpointangle;
-	//extern float k_segmentlengthwidthratio;
-	extern float k_segmentsanglewindow;
-	extern uint16_t k_vanishingpointx;
-	extern uint16_t k_vanishingpointy;
+	uint16_t k_segmentminimumsize{ 30 };			//Scaled to image size
+	uint16_t k_verticalsegmentlimit{ 250 };			//Scaled to image size
+	float k_maxvanishingpointangle{ 18.0f };
+	//float k_segmentlengthwidthratio;
+	uint16_t k_vanishingpointx{ 400 };				//Scaled to image size
+	uint16_t k_vanishingpointy{ 250 };				//Scaled to image size
+	
+	//Contour construction filter
+	float k_segmentsanglewindow{ 34.0f };
 	
 	//Contour filtering
-	extern uint16_t k_minimumsize;
-	extern float k_minimumangle;
-	extern float k_lengthwidthratio;
+	uint16_t k_minimumsize{ 36 };					//Scaled to image size
+	float k_minimumangle{ 24.0f };
+	float k_lengthwidthratio{ 3.5f };
 	
 	//Polygon filtering
-    extern uint16_t k_minroadwidth;
-    extern uint16_t k_maxroadwidth;
+    uint16_t k_minroadwidth{ 500 };					//Scaled to image size
+    uint16_t k_maxroadwidth{ 660 };					//Scaled to image size
 	
 	//Scoring
-	extern float k_anglefromcenter;
-	extern uint16_t k_minimumpolygonheight;
-	extern float k_lowestscorelimit;
-	extern float k_weightedheightwidth;
-	extern float k_weightedangleoffset;
-	extern float k_weightedcenteroffset;
-	
-}
+	float k_anglefromcenter{ 26.0f };
+	uint16_t k_minimumpolygonheight{ 12 };			//Scaled to image size
+	float k_lowestscorelimit{ -400.0f };
+	float k_weightedheightwidth{ 100.0f };			//Scaled to image size
+	float k_weightedangleoffset{ -1.0f };
+	float k_weightedcenteroffset{ -1.0f };			//Scaled to image size
+	
+};
+
+bool SetLaneDetectConstant( LaneDetectConstants& constants,
+							const std::string& variablename,
+							double value );
+bool IsIntegerLaneDetectConstant( const std::string& variablename );
 
 #endif // LANEDETECTCONSTANTS_H
@@ -15,9 +15,17 @@
 #include <iostream>
 #include <ctime>
 #include <sys/time.h>
-#include <deque>
 #include <algorithm>
 #include <math.h>
+#include <numeric>
+#include <tuple>
+#include <limits>
+#if defined(__AVX2__)
+	#include <immintrin.h>
+#endif
+#if defined(__SSE2__)
+	#include <emmintrin.h>
+#endif
 
 //3rd party libraries
 #include "opencv2/core/core.hpp"
@@ -42,141 +50,762 @@
 #define DEGREESPERRADIAN 57.2957795131f
 
 /*****************************************************************************************/
-namespace lanedetectconstants {
-	//Image evaluation
-	float k_contrastscalefactor{ 0.3f };
-	
-	//Segment filtering
-	uint16_t k_segmentminimumsize{ 30 };			//Relative to image size, must change
-	uint16_t k_verticalsegmentlimit{ 250 };			//Relative to image size, must change
-	float k_maxvanishingpointangle{ 18.0f };
-	uint16_t k_vanishingpointx{ 400 };				//Relative to image size, must change
-	uint16_t k_vanishingpointy{ 250 };				//Relative to image size, must change
-	
-	//Contour construction filter
-	float k_segmentsanglewindow{ 34.0f };
-	
-	//Contour filtering
-	uint16_t k_minimumsize{ 36 };					//Relative to image size, must change
-	float k_minimumangle{ 24.0f };
-	float k_lengthwidthratio{ 3.5f };
+namespace {
+	//Name lookup for the learner, each entry points at either a float or integer member
+	struct ConstantEntry {
+		const char* name;
+		float LaneDetectConstants::* floatmember;
+		uint16_t LaneDetectConstants::* integermember;
+	};
+	const ConstantEntry k_constantentries[]{
+		{ "k_contrastscalefactor", &LaneDetectConstants::k_contrastscalefactor, nullptr },
+		{ "k_segmentminimumsize", nullptr, &LaneDetectConstants::k_segmentminimumsize },
+		{ "k_verticalsegmentlimit", nullptr, &LaneDetectConstants::k_verticalsegmentlimit },
+		{ "k_maxvanishingpointangle", &LaneDetectConstants::k_maxvanishingpointangle, nullptr },
+		{ "k_vanishingpointx", nullptr, &LaneDetectConstants::k_vanishingpointx },
+		{ "k_vanishingpointy", nullptr, &LaneDetectConstants::k_vanishingpointy },
+		{ "k_segmentsanglewindow", &LaneDetectConstants::k_segmentsanglewindow, nullptr },
+		{ "k_minimumsize", nullptr, &LaneDetectConstants::k_minimumsize },
+		{ "k_minimumangle", &LaneDetectConstants::k_minimumangle, nullptr },
+		{ "k_lengthwidthratio", &LaneDetectConstants::k_lengthwidthratio, nullptr },
+		{ "k_minroadwidth", nullptr, &LaneDetectConstants::k_minroadwidth },
+		{ "k_maxroadwidth", nullptr, &LaneDetectConstants::k_maxroadwidth },
+		{ "k_anglefromcenter", &LaneDetectConstants::k_anglefromcenter, nullptr },
+		{ "k_minimumpolygonheight", nullptr, &LaneDetectConstants::k_minimumpolygonheight },
+		{ "k_lowestscorelimit", &LaneDetectConstants::k_lowestscorelimit, nullptr },
+		{ "k_weightedheightwidth", &LaneDetectConstants::k_weightedheightwidth, nullptr },
+		{ "k_weightedangleoffset", &LaneDetectConstants::k_weightedangleoffset, nullptr },
+		{ "k_weightedcenteroffset", &LaneDetectConstants::k_weightedcenteroffset, nullptr }
+	};
 	
-	//Polygon filtering
-    uint16_t k_minroadwidth{ 500 };					//Relative to image size, must change
-    uint16_t k_maxroadwidth{ 660 };					//Relative to image size, must change
+	//Right contours scored per ScorePairs call, a multiple of every kernel's lane count
+	const int k_pairblock{ 32 };
 	
-	//Scoring
-	float k_anglefromcenter{ 26.0f };
-	uint16_t k_minimumpolygonheight{ 12 };			//Relative to image size, must change
-	float k_lowestscorelimit{ -400.0f };			//Relative to image size, must change
-	float k_weightedheightwidth{ 100.0f };			//Relative to image size, must change
-	float k_weightedangleoffset{ -1.0f };
-	float k_weightedcenteroffset{ -1.0f };			//Relative to image size, must change
+	//Rows converted to gray at a time by PreprocessImageFused, small enough that the
+	//tile is still in cache when it is blurred
+	const int k_preprocesstilerows{ 16 };
+}
 
+/*****************************************************************************************/
+bool SetLaneDetectConstant( LaneDetectConstants& constants,
+							const std::string& variablename,
+							double value )
+{
+	for ( const ConstantEntry& entry : k_constantentries ) {
+		if ( variablename != entry.name ) continue;
+		if ( entry.floatmember != nullptr ) {
+			constants.*entry.floatmember = value;
+		} else {
+			constants.*entry.integermember = value;
+		}
+		return true;
+	}
+	return false;
+}
+
+/*****************************************************************************************/
+bool IsIntegerLaneDetectConstant( const std::string& variablename )
+{
+	for ( const ConstantEntry& entry : k_constantentries ) {
+		if ( variablename == entry.name ) return entry.integermember != nullptr;
+	}
+	return false;
 }
 
 //Main function
-void ProcessImage ( cv::Mat& image,
-                    Polygon& polygon )
+void ProcessImage ( const cv::Mat& image,
+                    const LaneDetectConstants& constants,
+                    Polygon& polygon,
+					ProcessingWorkspace* workspace )
+{
+	ProcessingWorkspace localworkspace;
+	if ( workspace == nullptr ) workspace = &localworkspace;
+	PreprocessImage( image,
+					 workspace->blurredimage,
+					 workspace,
+					 &workspace->cache,
+					 constants.k_downscale );
+	ProcessBlurredImage( workspace->blurredimage,
+						 constants,
+						 polygon,
+						 &workspace->cache,
+						 workspace );
+	return;
+}
+
+/*****************************************************************************************/
+void ProcessImageLuma ( const uchar* luma,
+						const int width,
+						const int height,
+						const size_t stride,
+						const LaneDetectConstants& constants,
+						Polygon& polygon,
+						ProcessingWorkspace* workspace )
+{
+	//Luma plane of an NV12 or I420 frame is already the gray image, wrap it in place.
+	//Only read, gray input is never written by PreprocessImage.
+	const cv::Mat lumaimage( height, width, CV_8UC1, const_cast<uchar*>(luma), stride );
+	ProcessImage( lumaimage, constants, polygon, workspace );
+	return;
+}
+
+/*****************************************************************************************/
+void PreprocessImage ( const cv::Mat& input,
+                       cv::Mat& blurredimage,
+					   ProcessingWorkspace* workspace,
+					   ProcessingCache* cache,
+					   const int downscale )
 {
 //-----------------------------------------------------------------------------------------
 //Image manipulation
 //-----------------------------------------------------------------------------------------
-	//Change to grayscale
-	cv::cvtColor( image, image, CV_BGR2GRAY );
+	ProcessingWorkspace localworkspace;
+	if ( workspace == nullptr ) workspace = &localworkspace;
+	
+	//Shrink before anything else so every later stage works on fewer pixels.  Rows and
+	//columns past a multiple of the factor are dropped, so the ratio is exactly downscale
+	//and polygons scale back to the frame without drifting.
+	const cv::Mat* scaledimage{ &input };
+	if ( downscale > 1 ) {
+		const cv::Size scaledsize{ input.cols / downscale, input.rows / downscale };
+		const cv::Mat croppedinput{ input(cv::Rect(0,
+												   0,
+												   scaledsize.width * downscale,
+												   scaledsize.height * downscale)) };
+		const cv::Mat* grayinput{ &croppedinput };
+		if ( input.channels() == 3 ) {
+			cv::cvtColor( croppedinput, workspace->grayimage, CV_BGR2GRAY );
+			grayinput = &workspace->grayimage;
+		}
+		cv::resize( *grayinput,
+					workspace->downscaledimage,
+					scaledsize,
+					0,
+					0,
+					cv::INTER_AREA );
+		scaledimage = &workspace->downscaledimage;
+	}
+	const cv::Mat& image{ *scaledimage };
+	
+	//Grayscale, blur and, when a cache is given, image statistics in one pass
+	double standarddeviation{0.0};
+	if ( !PreprocessImageFused(image,
+							   blurredimage,
+							   *workspace,
+							   (cache != nullptr) ? &standarddeviation : nullptr) ) {
+		//Change to grayscale, cached frames are already converted.  Gray input is read
+		//in place and never aliased into the workspace, which may be written next frame.
+		const cv::Mat* grayimage{ &image };
+		if ( image.channels() == 3 ) {
+			cv::cvtColor( image, workspace->grayimage, CV_BGR2GRAY );
+			grayimage = &workspace->grayimage;
+		}
+		
+		//Blur to reduce noise, never in place so cached frames are untouched
+		cv::blur( *grayimage, blurredimage, cv::Size(3,3) );
+		if ( cache != nullptr ) {
+			cv::Scalar mean;     
+			cv::Scalar std;
+			cv::meanStdDev( blurredimage, mean, std );
+			standarddeviation = std[0];
+		}
+	}
+	
+	//Start the cache over for this frame with its statistics already known
+	if ( cache != nullptr ) {
+		cache->Invalidate();
+		cache->standarddeviation = standarddeviation;
+		cache->imagewidth = blurredimage.cols;
+		cache->imageheight = blurredimage.rows;
+		cache->statsvalid = true;
+	}
+	return;
+}
+
+/*****************************************************************************************/
+namespace {
+	//OpenCV's 3x3 box filter divides a 16 bit sum by 9 as ((sum + 4) * 7282) >> 16,
+	//reproduced here so the result is identical to cv::blur
+	const int k_blurrounding{ 4 };
+	const int k_blurscale{ 7282 };
+	
+	int ReflectRow( int y,
+					const int height )
+	{
+		//BORDER_REFLECT_101, the cv::blur default
+		if ( y < 0 ) y = -y;
+		if ( y >= height ) y = 2 * height - 2 - y;
+		return y;
+	}
+	
+	//Blur one row from the gray rows around it and add it to the statistics
+	void BlurRow( const uchar* above,
+				  const uchar* row,
+				  const uchar* below,
+				  const int width,
+				  uint16_t* columnsums,
+				  uchar* output,
+				  uint64_t* sum,
+				  uint64_t* sumsquares )
+	{
+		//Vertical sums
+		int x{0};
+#if defined(__SSE2__)
+		const __m128i zero{ _mm_setzero_si128() };
+		for ( ; (x + 16) <= width; x += 16 ) {
+			__m128i a{ _mm_loadu_si128(reinterpret_cast<const __m128i*>(above + x)) };
+			__m128i b{ _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x)) };
+			__m128i c{ _mm_loadu_si128(reinterpret_cast<const __m128i*>(below + x)) };
+			__m128i low{ _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(a, zero),
+													 _mm_unpacklo_epi8(b, zero)),
+									   _mm_unpacklo_epi8(c, zero)) };
+			__m128i high{ _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(a, zero),
+													  _mm_unpackhi_epi8(b, zero)),
+										_mm_unpackhi_epi8(c, zero)) };
+			_mm_storeu_si128( reinterpret_cast<__m128i*>(columnsums + x), low );
+			_mm_storeu_si128( reinterpret_cast<__m128i*>(columnsums + x + 8), high );
+		}
+#endif
+		for ( ; x < width; x++ ) {
+			columnsums[x] = above[x] + row[x] + below[x];
+		}
+		
+		//Horizontal sums, the edge columns reflect like the edge rows
+		output[0] = ((2 * columnsums[1] + columnsums[0] + k_blurrounding) * k_blurscale) >> 16;
+		x = 1;
+#if defined(__SSE2__)
+		const __m128i rounding{ _mm_set1_epi16(k_blurrounding) };
+		const __m128i scale{ _mm_set1_epi16(k_blurscale) };
+		for ( ; (x + 8) <= (width - 1); x += 8 ) {
+			__m128i total{ _mm_add_epi16(
+				_mm_add_epi16(
+					_mm_loadu_si128(reinterpret_cast<const __m128i*>(columnsums + x - 1)),
+					_mm_loadu_si128(reinterpret_cast<const __m128i*>(columnsums + x))),
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(columnsums + x + 1))) };
+			__m128i blurred{ _mm_mulhi_epu16(_mm_add_epi16(total, rounding), scale) };
+			_mm_storel_epi64( reinterpret_cast<__m128i*>(output + x),
+							  _mm_packus_epi16(blurred, zero) );
+		}
+#endif
+		for ( ; x < (width - 1); x++ ) {
+			output[x] = ((columnsums[x - 1] + columnsums[x] + columnsums[x + 1] +
+						  k_blurrounding) * k_blurscale) >> 16;
+		}
+		output[width - 1] = ((2 * columnsums[width - 2] + columnsums[width - 1] +
+							  k_blurrounding) * k_blurscale) >> 16;
+		
+		//Sum and sum of squares of the blurred row
+		if ( sum == nullptr ) return;
+		x = 0;
+		uint64_t rowsum{0};
+		uint64_t rowsumsquares{0};
+#if defined(__SSE2__)
+		//Squares are summed in 32 bit lanes, which can't overflow within one row
+		__m128i sums{ zero };
+		__m128i squares{ zero };
+		for ( ; (x + 16) <= width; x += 16 ) {
+			__m128i pixels{ _mm_loadu_si128(reinterpret_cast<const __m128i*>(output + x)) };
+			sums = _mm_add_epi64( sums, _mm_sad_epu8(pixels, zero) );
+			__m128i low{ _mm_unpacklo_epi8(pixels, zero) };
+			__m128i high{ _mm_unpackhi_epi8(pixels, zero) };
+			squares = _mm_add_epi32( squares, _mm_madd_epi16(low, low) );
+			squares = _mm_add_epi32( squares, _mm_madd_epi16(high, high) );
+		}
+		uint64_t sumlanes[2];
+		uint32_t squarelanes[4];
+		_mm_storeu_si128( reinterpret_cast<__m128i*>(sumlanes), sums );
+		_mm_storeu_si128( reinterpret_cast<__m128i*>(squarelanes), squares );
+		rowsum = sumlanes[0] + sumlanes[1];
+		rowsumsquares = static_cast<uint64_t>(squarelanes[0]) + squarelanes[1] +
+						squarelanes[2] + squarelanes[3];
+#endif
+		for ( ; x < width; x++ ) {
+			rowsum += output[x];
+			rowsumsquares += output[x] * output[x];
+		}
+		*sum += rowsum;
+		*sumsquares += rowsumsquares;
+		return;
+	}
+}
+
+/*****************************************************************************************/
+bool PreprocessImageFused( const cv::Mat& image,
+						   cv::Mat& blurredimage,
+						   ProcessingWorkspace& workspace,
+						   double* standarddeviation )
+{
+	//Same results as cvtColor, blur and meanStdDev, for the frames this program reads
+	if ( (image.depth() != CV_8U) ||
+		 ((image.channels() != 1) && (image.channels() != 3)) ||
+		 (image.rows < 2) ||
+		 (image.cols < 2) ) return false;
+	const int width{ image.cols };
+	const int height{ image.rows };
+	const bool convert{ image.channels() == 3 };
+	
+	//Output is written while input rows are still being read, so never in place
+	if ( blurredimage.data == image.data ) blurredimage.release();
+	blurredimage.create( height, width, CV_8UC1 );
+	if ( convert ) workspace.grayimage.create( k_preprocesstilerows + 2, width, CV_8UC1 );
+	workspace.columnsums.resize( width );
+	
+	//A tile of rows is converted together with the row either side of it, then
+	//blurred while still in cache
+	uint64_t sum{0};
+	uint64_t sumsquares{0};
+	for ( int tiletop = 0; tiletop < height; tiletop += k_preprocesstilerows ) {
+		int tilerows{ std::min(k_preprocesstilerows, height - tiletop) };
+		int first{ std::max(tiletop - 1, 0) };
+		int last{ std::min(tiletop + tilerows, height - 1) };
+		if ( convert ) {
+			cv::Mat graytile{ workspace.grayimage.rowRange(0, last - first + 1) };
+			cv::cvtColor( image.rowRange(first, last + 1), graytile, CV_BGR2GRAY );
+		}
+		auto grayrow = [&]( int y ) {
+			y = ReflectRow( y, height );
+			return convert ? workspace.grayimage.ptr<uchar>(y - first) : image.ptr<uchar>(y);
+		};
+		for ( int y = tiletop; y < (tiletop + tilerows); y++ ) {
+			BlurRow( grayrow(y - 1),
+					 grayrow(y),
+					 grayrow(y + 1),
+					 width,
+					 workspace.columnsums.data(),
+					 blurredimage.ptr<uchar>(y),
+					 (standarddeviation != nullptr) ? &sum : nullptr,
+					 &sumsquares );
+		}
+	}
 	
-	//Blur to reduce noise
-    cv::blur( image, image, cv::Size(3,3) );
+	//Same arithmetic as meanStdDev
+	if ( standarddeviation != nullptr ) {
+		double scale{ 1.0 / (static_cast<double>(width) * height) };
+		double mean{ sum * scale };
+		*standarddeviation = sqrt( std::max(sumsquares * scale - mean * mean, 0.0) );
+	}
+	return true;
+}
+
+/*****************************************************************************************/
+void ProcessBlurredImage ( const cv::Mat& blurredimage,
+                           const LaneDetectConstants& referenceconstants,
+                           Polygon& polygon,
+						   ProcessingCache* cache,
+						   ProcessingWorkspace* workspace )
+{
+	//Constants are given for the reference frame, scale them to this image
+	LaneDetectConstants scaledconstants;
+	const LaneDetectConstants& constants{ ScaleLaneDetectConstants(referenceconstants,
+																   blurredimage.size(),
+																   scaledconstants) };
+	
+	//Without a cache every stage runs, reusing the workspace buffers if given
+	ProcessingWorkspace localworkspace;
+	if ( workspace == nullptr ) workspace = &localworkspace;
+	if ( cache == nullptr ) {
+		cache = &workspace->cache;
+		cache->Invalidate();
+	}
+	
+//-----------------------------------------------------------------------------------------
+//Image statistics, independent of all constants
+//-----------------------------------------------------------------------------------------
+	if ( !cache->statsvalid ) {
+		cv::Scalar mean;     
+		cv::Scalar std;
+		cv::meanStdDev(blurredimage, mean, std);
+		cache->standarddeviation = std[0];
+		cache->imagewidth = blurredimage.cols;
+		cache->imageheight = blurredimage.rows;
+		cache->statsvalid = true;
+	}
 	
 //-----------------------------------------------------------------------------------------
 //Find contours
 //-----------------------------------------------------------------------------------------
-	//Auto threshold values for canny edge detection
-	cv::Scalar mean;     
-	cv::Scalar std;
-	cv::meanStdDev(image, mean, std);
-	double lowerthreshold{ lanedetectconstants::k_contrastscalefactor * std[0] };
-	
-	//Canny edge detection
-    cv::Canny( image, image, lowerthreshold, 3 * lowerthreshold );
-	std::vector<Contour> detectedcontours;
-    std::vector<cv::Vec4i> detectedhierarchy;
-    cv::findContours( image,
-					  detectedcontours,
-					  detectedhierarchy,
-					  CV_RETR_CCOMP,
-					  CV_CHAIN_APPROX_SIMPLE );
+	int roitop{ RoiTop(constants, blurredimage.rows) };
+	if ( !cache->contoursvalid ||
+		 (cache->contrastscalefactor != constants.k_contrastscalefactor) ||
+		 (cache->roitop != roitop) ) {
+		cache->contrastscalefactor = constants.k_contrastscalefactor;
+		cache->roitop = roitop;
+		FindContours( blurredimage,
+					  cache->standarddeviation,
+					  constants,
+					  workspace->edgeimage,
+					  cache->detectedcontours,
+					  cache->detectedhierarchy );
+		cache->contoursvalid = true;
+		cache->segmentsvalid = false;
+	}
 		
 //-----------------------------------------------------------------------------------------
 //Evaluate contours
 //-----------------------------------------------------------------------------------------	
-	std::vector<EvaluatedContour> evaluatedchildsegments;
-	std::vector<EvaluatedContour> evaluatedparentsegments; 
-    for ( int i = 0; i < detectedcontours.size(); i++ ) {
-        if ( detectedhierarchy[i][3] > -1 ) {
-			EvaluateSegment( detectedcontours[i], evaluatedchildsegments );
-        } else {
-			EvaluateSegment( detectedcontours[i], evaluatedparentsegments );
+	SegmentKey segmentkey{ GetSegmentKey(constants) };
+	if ( !cache->segmentsvalid || !(cache->segmentkey == segmentkey) ) {
+		cache->segmentkey = segmentkey;
+		cache->evaluatedchildsegments.clear();
+		cache->evaluatedparentsegments.clear();
+		for ( int i = 0; i < cache->detectedcontours.size(); i++ ) {
+			if ( cache->detectedhierarchy[i][3] > -1 ) {
+				EvaluateSegment( cache->detectedcontours[i],
+								 constants,
+								 cache->evaluatedchildsegments );
+			} else {
+				EvaluateSegment( cache->detectedcontours[i],
+								 constants,
+								 cache->evaluatedparentsegments );
+			}
 		}
-    }
+		cache->segmentsvalid = true;
+		cache->sortedvalid = false;
+	}
 
 //-----------------------------------------------------------------------------------------
 //Filter and sort all evaluated contours
 //-----------------------------------------------------------------------------------------	
-	std::vector<EvaluatedContour> leftcontours;
-	std::vector<EvaluatedContour> rightcontours;
-	SortContours( evaluatedparentsegments, image.cols, leftcontours, rightcontours );
-	SortContours( evaluatedchildsegments, image.cols, leftcontours, rightcontours );
+	SortKey sortkey{ GetSortKey(constants) };
+	if ( !cache->sortedvalid || !(cache->sortkey == sortkey) ) {
+		cache->sortkey = sortkey;
+		cache->leftcontours.clear();
+		cache->rightcontours.clear();
+		SortContours( cache->evaluatedparentsegments,
+					  cache->imagewidth,
+					  constants,
+					  cache->leftcontours,
+					  cache->rightcontours );
+		SortContours( cache->evaluatedchildsegments,
+					  cache->imagewidth,
+					  constants,
+					  cache->leftcontours,
+					  cache->rightcontours );
+		BuildPairSearchIndex( cache->leftcontours,
+							  cache->rightcontours,
+							  cache->imageheight,
+							  cache->pairindex );
+		cache->sortedvalid = true;
+	}
 	
 //-----------------------------------------------------------------------------------------
-//Find highest scoring pair of contours
+//Find highest scoring pair of contours, always rerun
 //-----------------------------------------------------------------------------------------	
+	FindBestPolygon( cache->leftcontours,
+					 cache->rightcontours,
+					 cache->pairindex,
+					 cache->imagewidth,
+					 cache->imageheight,
+					 constants,
+					 polygon );
+	
+	//Back to full resolution when processing a downscaled frame
+	if ( (constants.k_downscale > 1) && (polygon[0] != cv::Point(0,0)) ) {
+		for ( cv::Point& point : polygon ) {
+			point *= constants.k_downscale;
+		}
+	}
+	return;
+}
+
+/*****************************************************************************************/
+void ProcessBlurredImageTracked ( const cv::Mat& blurredimage,
+								  const LaneDetectConstants& referenceconstants,
+								  const Polygon& predictedpolygon,
+								  Polygon& polygon,
+								  ProcessingWorkspace* workspace )
+{
+	LaneDetectConstants scaledconstants;
+	const LaneDetectConstants& constants{ ScaleLaneDetectConstants(referenceconstants,
+																   blurredimage.size(),
+																   scaledconstants) };
+	ProcessingWorkspace localworkspace;
+	if ( workspace == nullptr ) workspace = &localworkspace;
+	ProcessingCache& cache{ workspace->cache };
+	
+	//Statistics stay full frame so Canny thresholds match the full search
+	if ( !cache.statsvalid ) {
+		cv::Scalar mean;     
+		cv::Scalar std;
+		cv::meanStdDev(blurredimage, mean, std);
+		cache.standarddeviation = std[0];
+		cache.imagewidth = blurredimage.cols;
+		cache.imageheight = blurredimage.rows;
+		cache.statsvalid = true;
+	}
+	
+	//Later stages are rebuilt from the bands, so none of the full frame ones survive
+	cache.contoursvalid = false;
+	cache.segmentsvalid = false;
+	cache.sortedvalid = false;
+	
+	//Left line runs from corner 3 down to corner 0, right line from corner 2 down to 1.
+	//Prediction is at full resolution, the image may be downscaled.
+	auto toimage = [&constants]( const cv::Point& point ) {
+		return cv::Point( point.x / constants.k_downscale, point.y / constants.k_downscale );
+	};
+	const cv::Point lines[2][2]{ { toimage(predictedpolygon[3]), toimage(predictedpolygon[0]) },
+								 { toimage(predictedpolygon[2]), toimage(predictedpolygon[1]) } };
+	std::vector<EvaluatedContour>* sidecontours[2]{ &cache.leftcontours,
+													&cache.rightcontours };
+	
+	//Contours found in a line's band are only candidates for that side
+	for ( int side = 0; side < 2; side++ ) {
+		FindBandContours( blurredimage,
+						  cache.standarddeviation,
+						  constants,
+						  lines[side][0],
+						  lines[side][1],
+						  *workspace );
+		cache.evaluatedchildsegments.clear();
+		cache.evaluatedparentsegments.clear();
+		for ( int i = 0; i < workspace->bandcontours.size(); i++ ) {
+			if ( workspace->bandhierarchy[i][3] > -1 ) {
+				EvaluateSegment( workspace->bandcontours[i],
+								 constants,
+								 cache.evaluatedchildsegments );
+			} else {
+				EvaluateSegment( workspace->bandcontours[i],
+								 constants,
+								 cache.evaluatedparentsegments );
+			}
+		}
+		sidecontours[side]->clear();
+		for ( const EvaluatedContour& evaluatedcontour : cache.evaluatedparentsegments ) {
+			if ( KeepContour(evaluatedcontour, constants) ) {
+				sidecontours[side]->push_back( evaluatedcontour );
+			}
+		}
+		for ( const EvaluatedContour& evaluatedcontour : cache.evaluatedchildsegments ) {
+			if ( KeepContour(evaluatedcontour, constants) ) {
+				sidecontours[side]->push_back( evaluatedcontour );
+			}
+		}
+	}
+	
+	//Same pair search and scoring as the full frame
+	BuildPairSearchIndex( cache.leftcontours,
+						  cache.rightcontours,
+						  cache.imageheight,
+						  cache.pairindex );
+	FindBestPolygon( cache.leftcontours,
+					 cache.rightcontours,
+					 cache.pairindex,
+					 cache.imagewidth,
+					 cache.imageheight,
+					 constants,
+					 polygon );
+	if ( (constants.k_downscale > 1) && (polygon[0] != cv::Point(0,0)) ) {
+		for ( cv::Point& point : polygon ) {
+			point *= constants.k_downscale;
+		}
+	}
+	return;
+}
+
+/*****************************************************************************************/
+void FindBandContours( const cv::Mat& blurredimage,
+					   const double standarddeviation,
+					   const LaneDetectConstants& constants,
+					   const cv::Point& linetop,
+					   const cv::Point& linebottom,
+					   ProcessingWorkspace& workspace )
+{
+	workspace.bandcontours.clear();
+	workspace.bandhierarchy.clear();
+	
+	//Line widened by the band width each side, and lengthened by as much above its top
+	//so the lane can still grow toward the vanishing point
+	const int bandwidth{ constants.k_trackingbandwidth };
+	cv::Point band[4]{ cv::Point(linetop.x - bandwidth, linetop.y - bandwidth),
+					   cv::Point(linetop.x + bandwidth, linetop.y - bandwidth),
+					   cv::Point(linebottom.x + bandwidth, linebottom.y),
+					   cv::Point(linebottom.x - bandwidth, linebottom.y) };
+	
+	//Bounding rectangle, kept inside the image and the region of interest
+	int roitop{ RoiTop(constants, blurredimage.rows) };
+	int minx{ std::min(band[0].x, band[3].x) };
+	int maxx{ std::max(band[1].x, band[2].x) };
+	int miny{ std::min(band[0].y, band[3].y) };
+	int maxy{ std::max(band[0].y, band[3].y) };
+	cv::Rect bandrect{ cv::Rect(minx, miny, maxx - minx + 1, maxy - miny + 1) &
+					   cv::Rect(0, roitop, blurredimage.cols, blurredimage.rows - roitop) };
+	if ( bandrect.area() == 0 ) return;
+	
+	//Canny over the rectangle only, then edges outside the band itself are dropped.
+	//Like the region of interest, the rectangle's border cuts Canny's neighbourhood.
+	double lowerthreshold{ constants.k_contrastscalefactor * standarddeviation };
+	cv::Canny( blurredimage(bandrect), workspace.edgeimage, lowerthreshold, 3 * lowerthreshold );
+	for ( cv::Point& point : band ) {
+		point -= bandrect.tl();
+	}
+	workspace.bandmask.create( bandrect.size(), CV_8UC1 );
+	workspace.bandmask.setTo( cv::Scalar(0) );
+	cv::fillConvexPoly( workspace.bandmask, band, 4, cv::Scalar(255) );
+	cv::bitwise_and( workspace.edgeimage, workspace.bandmask, workspace.edgeimage );
+	cv::findContours( workspace.edgeimage,
+					  workspace.bandcontours,
+					  workspace.bandhierarchy,
+					  CV_RETR_CCOMP,
+					  CV_CHAIN_APPROX_SIMPLE,
+					  bandrect.tl() );
+	return;
+}
+
+/*****************************************************************************************/
+const LaneDetectConstants& ScaleLaneDetectConstants( const LaneDetectConstants& constants,
+													 const cv::Size imagesize,
+													 LaneDetectConstants& scaledconstants )
+{
+	if ( (imagesize.width == k_referencewidth) &&
+		 (imagesize.height == k_referenceheight) ) return constants;
+	float scalex{ static_cast<float>(imagesize.width) / k_referencewidth };
+	float scaley{ static_cast<float>(imagesize.height) / k_referenceheight };
+	float scalelength{ sqrtf(scalex * scaley) };
+	auto scale = []( uint16_t value, float factor ) {
+		return static_cast<uint16_t>( value * factor + 0.5f );
+	};
+	scaledconstants = constants;
+	
+	//Positions and sizes
+	scaledconstants.k_roimargin = scale( constants.k_roimargin, scaley );
+	scaledconstants.k_trackingbandwidth = scale( constants.k_trackingbandwidth, scalex );
+	scaledconstants.k_trackingmaxdeviation = scale( constants.k_trackingmaxdeviation, scalex );
+	scaledconstants.k_verticalsegmentlimit = scale( constants.k_verticalsegmentlimit, scaley );
+	scaledconstants.k_vanishingpointx = scale( constants.k_vanishingpointx, scalex );
+	scaledconstants.k_vanishingpointy = scale( constants.k_vanishingpointy, scaley );
+	scaledconstants.k_minroadwidth = scale( constants.k_minroadwidth, scalex );
+	scaledconstants.k_maxroadwidth = scale( constants.k_maxroadwidth, scalex );
+	scaledconstants.k_minimumpolygonheight = scale( constants.k_minimumpolygonheight, scaley );
+	
+	//Contour point counts grow with the length of the edge
+	scaledconstants.k_segmentminimumsize = scale( constants.k_segmentminimumsize, scalelength );
+	scaledconstants.k_minimumsize = scale( constants.k_minimumsize, scalelength );
+	
+	//Weights of pixel measured terms, so a polygon scores the same at any size
+	scaledconstants.k_weightedheightwidth = constants.k_weightedheightwidth * scalex / scaley;
+	scaledconstants.k_weightedcenteroffset = constants.k_weightedcenteroffset / scalex;
+	return scaledconstants;
+}
+
+/*****************************************************************************************/
+void FindContours( const cv::Mat& blurredimage,
+				   const double standarddeviation,
+				   const LaneDetectConstants& constants,
+				   cv::Mat& edgeimage,
+				   std::vector<Contour>& detectedcontours,
+				   std::vector<cv::Vec4i>& detectedhierarchy )
+{
+	//Auto threshold values for canny edge detection
+	double lowerthreshold{ constants.k_contrastscalefactor * standarddeviation };
+	
+	//Crop to the region of interest, a view so nothing is copied
+	int roitop{ RoiTop(constants, blurredimage.rows) };
+	cv::Mat roiimage{ blurredimage.rowRange(roitop, blurredimage.rows) };
+	
+	//Canny writes into its own buffer, input may be read only mapped memory
+    cv::Canny( roiimage, edgeimage, lowerthreshold, 3 * lowerthreshold );
+    cv::findContours( edgeimage,
+					  detectedcontours,
+					  detectedhierarchy,
+					  CV_RETR_CCOMP,
+					  CV_CHAIN_APPROX_SIMPLE,
+					  cv::Point(0, roitop) );
+	return;
+}
+
+/*****************************************************************************************/
+int RoiTop( const LaneDetectConstants& constants,
+			const int imageheight )
+{
+	//First row processed, whole frame when the region of interest is off
+	if ( !constants.k_useroi ) return 0;
+	int roitop{ constants.k_verticalsegmentlimit - constants.k_roimargin };
+	return std::min( std::max(roitop, 0), imageheight - 1 );
+}
+
+/*****************************************************************************************/
+void FindBestPolygon( const std::vector<EvaluatedContour>& leftcontours,
+					  const std::vector<EvaluatedContour>& rightcontours,
+					  const PairSearchIndex& pairindex,
+					  const int imagewidth,
+					  const int imageheight,
+					  const LaneDetectConstants& constants,
+					  Polygon& polygon )
+{
 	Polygon bestpolygon{ cv::Point(0,0),
 						 cv::Point(0,0),
 						 cv::Point(0,0),
 						 cv::Point(0,0) };
-	float maxscore{ lanedetectconstants::k_lowestscorelimit };
-	EvaluatedContour leftcontour;
-	EvaluatedContour rightcontour;
+	float maxscore{ constants.k_lowestscorelimit };
+	int bestleft{ -1 };
+	int bestright{ -1 };
+	const ContourTable& lefttable{ pairindex.left };
+	const ContourTable& angletable{ pairindex.rightbyangle };
+	const ContourTable& bottomtable{ pairindex.rightbybottomx };
 	
 	//Find best score
-	for ( const EvaluatedContour &leftevaluatedcontour : leftcontours ) {
-		for ( const EvaluatedContour &rightevaluatedcontour : rightcontours ) {
-			//Check sum angle
-			if ( (fabs(180.0f - leftevaluatedcontour.angle - rightevaluatedcontour.angle) *
-				  0.5f) > lanedetectconstants::k_anglefromcenter ) continue;
-			
-			Polygon newpolygon{ cv::Point(0,0),
-								cv::Point(0,0),
-								cv::Point(0,0),
-								cv::Point(0,0) };
-			FindPolygon( newpolygon,
-						 leftevaluatedcontour,
-						 rightevaluatedcontour,
-						 image.rows );
-				
-			//If invalid polygon created, goto next
-			if ( newpolygon[0] == cv::Point(0,0) ) continue;
-			
-			//Score
-			float score{ Score(newpolygon,
-						 leftevaluatedcontour,
-						 rightevaluatedcontour,
-						 image.cols) };
+	for ( int i = 0; i < lefttable.index.size(); i++ ) {
+		//Right angles that can pass the sum angle check, widened for rounding since
+		//the exact check is repeated per pair
+		float anglecenter{ 180.0f - lefttable.angle[i] };
+		float anglewindow{ 2.0f * constants.k_anglefromcenter + 0.01f };
+		int anglefirst = std::lower_bound( angletable.angle.begin(),
+										   angletable.angle.end(),
+										   anglecenter - anglewindow ) -
+						 angletable.angle.begin();
+		int anglelast = std::upper_bound( angletable.angle.begin(),
+										  angletable.angle.end(),
+										  anglecenter + anglewindow ) -
+						angletable.angle.begin();
+		
+		//Right bottoms giving a road width within limits
+		int64_t leftbottomx{ lefttable.bottomx[i] };
+		int bottomfirst = std::lower_bound( bottomtable.bottomx.begin(),
+											bottomtable.bottomx.end(),
+											leftbottomx + constants.k_minroadwidth ) -
+						  bottomtable.bottomx.begin();
+		int bottomlast = std::upper_bound( bottomtable.bottomx.begin(),
+										   bottomtable.bottomx.end(),
+										   leftbottomx + constants.k_maxroadwidth ) -
+						 bottomtable.bottomx.begin();
+		
+		//Walk the smaller window, every check is applied per pair
+		const ContourTable* righttable{ &angletable };
+		int first{ anglefirst };
+		int last{ anglelast };
+		if ( (bottomlast - bottomfirst) < (anglelast - anglefirst) ) {
+			righttable = &bottomtable;
+			first = bottomfirst;
+			last = bottomlast;
+		}
+		float scores[k_pairblock];
+		for ( int k = first; k < last; k += k_pairblock ) {
+			int count{ std::min(k_pairblock, last - k) };
+			ScorePairs( lefttable, i, *righttable, k, count, imagewidth, constants, scores );
 			
-			//If highest score update
-			if ( score > maxscore ) {
-				leftcontour = leftevaluatedcontour;
-				rightcontour = rightevaluatedcontour;
-				maxscore = score;
-				bestpolygon = newpolygon;
+			//If highest score update, ties go to the pair a full left by right scan
+			//would have reached first.  Rejected pairs score NaN and never compare.
+			for ( int m = 0; m < count; m++ ) {
+				int j{ righttable->index[k + m] };
+				if ( (scores[m] > maxscore) ||
+					 ((scores[m] == maxscore) && (bestleft == i) && (j < bestright)) ) {
+					bestleft = i;
+					bestright = j;
+					maxscore = scores[m];
+				}
 			}
 		}
 	}
 
 	//Set bottom of polygon equal to optimal polygon
-	if ( bestpolygon[0] != cv::Point(0,0) ) {
-		FindPolygon( bestpolygon, leftcontour, rightcontour, image.rows, true );
+	if ( bestleft >= 0 ) {
+		FindPolygon( bestpolygon,
+					 leftcontours[lefttable.index[bestleft]],
+					 rightcontours[bestright],
+					 imageheight,
+					 constants,
+					 true );
 	}
 	
 //-----------------------------------------------------------------------------------------
@@ -188,50 +817,499 @@ void ProcessImage ( cv::Mat& image,
 	return;
 }
 
+/*****************************************************************************************/
+void BuildPairSearchIndex( const std::vector<EvaluatedContour>& leftcontours,
+						   const std::vector<EvaluatedContour>& rightcontours,
+						   const int imageheight,
+						   PairSearchIndex& pairindex )
+{
+	std::vector<int> order( leftcontours.size() );
+	std::iota( order.begin(), order.end(), 0 );
+	BuildContourTable( leftcontours, order, imageheight, pairindex.left );
+	
+	//Both right orders read the projected bottoms, work them out once
+	std::vector<int> bottomx( rightcontours.size() );
+	for ( int i = 0; i < rightcontours.size(); i++ ) {
+		bottomx[i] = ProjectedBottomX( rightcontours[i], imageheight );
+	}
+	order.resize( rightcontours.size() );
+	std::iota( order.begin(), order.end(), 0 );
+	std::sort( order.begin(),
+			   order.end(),
+			   [&rightcontours]( int lhs, int rhs )
+			   { return rightcontours[lhs].angle < rightcontours[rhs].angle; } );
+	BuildContourTable( rightcontours, order, imageheight, pairindex.rightbyangle );
+	std::iota( order.begin(), order.end(), 0 );
+	std::sort( order.begin(),
+			   order.end(),
+			   [&bottomx]( int lhs, int rhs )
+			   { return bottomx[lhs] < bottomx[rhs]; } );
+	BuildContourTable( rightcontours, order, imageheight, pairindex.rightbybottomx );
+	return;
+}
+
+/*****************************************************************************************/
+void BuildContourTable( const std::vector<EvaluatedContour>& evaluatedcontours,
+						const std::vector<int>& order,
+						const int imageheight,
+						ContourTable& table )
+{
+	int count{ static_cast<int>(order.size()) };
+	table.index = order;
+	table.centerx.resize( count );
+	table.centery.resize( count );
+	table.slopeinverse.resize( count );
+	table.angle.resize( count );
+	table.miny.resize( count );
+	table.maxy.resize( count );
+	table.bottomx.resize( count );
+	for ( int i = 0; i < count; i++ ) {
+		const EvaluatedContour& evaluatedcontour{ evaluatedcontours[order[i]] };
+		table.centerx[i] = evaluatedcontour.center.x;
+		table.centery[i] = evaluatedcontour.center.y;
+		table.slopeinverse[i] = evaluatedcontour.fitline[0] / evaluatedcontour.fitline[1];
+		table.angle[i] = evaluatedcontour.angle;
+		table.miny[i] = evaluatedcontour.miny;
+		table.maxy[i] = evaluatedcontour.maxy;
+		table.bottomx[i] = ProjectedBottomX( evaluatedcontour, imageheight );
+	}
+	return;
+}
+
+/*****************************************************************************************/
+namespace {
+	//Sum angle check, FindPolygon with the actual maximum y and Score for a single pair,
+	//NaN where the pair is rejected.  Every kernel below follows the same arithmetic
+	//step for step, so all of them give identical scores.
+	float ScorePair( const ContourTable& lefttable,
+					 const int i,
+					 const ContourTable& righttable,
+					 const int j,
+					 const int imagewidth,
+					 const LaneDetectConstants& constants )
+	{
+		const float rejected{ std::numeric_limits<float>::quiet_NaN() };
+		float angleoffset{ fabs(180.0f - lefttable.angle[i] - righttable.angle[j]) * 0.5f };
+		if ( angleoffset > constants.k_anglefromcenter ) return rejected;
+		if ( lefttable.centerx[i] > righttable.centerx[j] ) return rejected;
+		float leftslopeinverse{ lefttable.slopeinverse[i] };
+		float rightslopeinverse{ righttable.slopeinverse[j] };
+		if ( (leftslopeinverse > 0.0f) && (rightslopeinverse < 0.0f) ) return rejected;
+		int roadwidth{ righttable.bottomx[j] - lefttable.bottomx[i] };
+		if ( roadwidth < constants.k_minroadwidth ) return rejected;
+		if ( roadwidth > constants.k_maxroadwidth ) return rejected;
+		int maxy{ std::max(lefttable.maxy[i], righttable.maxy[j]) };
+		int miny{ std::max(lefttable.miny[i], righttable.miny[j]) };
+		if ( (maxy - miny) < constants.k_minimumpolygonheight ) return rejected;
+		int bottomleftx = lefttable.centerx[i] + (maxy - lefttable.centery[i]) *
+						  leftslopeinverse;
+		int bottomrightx = righttable.centerx[j] + (maxy - righttable.centery[j]) *
+						   rightslopeinverse;
+		if ( (bottomleftx == 0) && (maxy == 0) ) return rejected;
+		float heightwidthratio{ static_cast<float>(maxy - miny) /
+								static_cast<float>(bottomrightx - bottomleftx) };
+		float centeroffset{ fabs((imagewidth - (bottomleftx + bottomrightx)) * 0.5f) };
+		return constants.k_weightedheightwidth * heightwidthratio +
+			   constants.k_weightedangleoffset * angleoffset +
+			   constants.k_weightedcenteroffset * centeroffset;
+	}
+
+#if defined(__AVX2__)
+	const int k_pairlanes{ 8 };
+
+	void ScorePairLanes( const ContourTable& lefttable,
+						 const int i,
+						 const ContourTable& righttable,
+						 const int j,
+						 const int imagewidth,
+						 const LaneDetectConstants& constants,
+						 float* scores )
+	{
+		__m256 rightangle{ _mm256_loadu_ps(&righttable.angle[j]) };
+		__m256 rightslopeinverse{ _mm256_loadu_ps(&righttable.slopeinverse[j]) };
+		__m256i rightcenterx{ _mm256_loadu_si256(
+			reinterpret_cast<const __m256i*>(&righttable.centerx[j])) };
+		__m256i rightcentery{ _mm256_loadu_si256(
+			reinterpret_cast<const __m256i*>(&righttable.centery[j])) };
+		__m256i rightminy{ _mm256_loadu_si256(
+			reinterpret_cast<const __m256i*>(&righttable.miny[j])) };
+		__m256i rightmaxy{ _mm256_loadu_si256(
+			reinterpret_cast<const __m256i*>(&righttable.maxy[j])) };
+		__m256i rightbottomx{ _mm256_loadu_si256(
+			reinterpret_cast<const __m256i*>(&righttable.bottomx[j])) };
+		float leftslopeinverse{ lefttable.slopeinverse[i] };
+		
+		//Sum angle
+		__m256 angleoffset{ _mm256_mul_ps(
+			_mm256_andnot_ps(_mm256_set1_ps(-0.0f),
+							 _mm256_sub_ps(_mm256_set1_ps(180.0f - lefttable.angle[i]),
+										   rightangle)),
+			_mm256_set1_ps(0.5f)) };
+		__m256 reject{ _mm256_cmp_ps(angleoffset,
+									 _mm256_set1_ps(constants.k_anglefromcenter),
+									 _CMP_GT_OQ) };
+		
+		//Left/right assignment and shape
+		__m256i rejectint{ _mm256_cmpgt_epi32(_mm256_set1_epi32(lefttable.centerx[i]),
+											  rightcenterx) };
+		if ( leftslopeinverse > 0.0f ) {
+			reject = _mm256_or_ps( reject, _mm256_cmp_ps(rightslopeinverse,
+														 _mm256_setzero_ps(),
+														 _CMP_LT_OQ) );
+		}
+		
+		//Road width and height
+		__m256i roadwidth{ _mm256_sub_epi32(rightbottomx,
+											_mm256_set1_epi32(lefttable.bottomx[i])) };
+		rejectint = _mm256_or_si256( rejectint, _mm256_cmpgt_epi32(
+			_mm256_set1_epi32(constants.k_minroadwidth), roadwidth) );
+		rejectint = _mm256_or_si256( rejectint, _mm256_cmpgt_epi32(
+			roadwidth, _mm256_set1_epi32(constants.k_maxroadwidth)) );
+		__m256i maxy{ _mm256_max_epi32(_mm256_set1_epi32(lefttable.maxy[i]), rightmaxy) };
+		__m256i miny{ _mm256_max_epi32(_mm256_set1_epi32(lefttable.miny[i]), rightminy) };
+		__m256i height{ _mm256_sub_epi32(maxy, miny) };
+		rejectint = _mm256_or_si256( rejectint, _mm256_cmpgt_epi32(
+			_mm256_set1_epi32(constants.k_minimumpolygonheight), height) );
+		
+		//Bottom corners
+		__m256i bottomleftx{ _mm256_cvttps_epi32(_mm256_add_ps(
+			_mm256_set1_ps(static_cast<float>(lefttable.centerx[i])),
+			_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(
+							  maxy, _mm256_set1_epi32(lefttable.centery[i]))),
+						  _mm256_set1_ps(leftslopeinverse)))) };
+		__m256i bottomrightx{ _mm256_cvttps_epi32(_mm256_add_ps(
+			_mm256_cvtepi32_ps(rightcenterx),
+			_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(maxy, rightcentery)),
+						  rightslopeinverse))) };
+		rejectint = _mm256_or_si256( rejectint, _mm256_and_si256(
+			_mm256_cmpeq_epi32(bottomleftx, _mm256_setzero_si256()),
+			_mm256_cmpeq_epi32(maxy, _mm256_setzero_si256())) );
+		reject = _mm256_or_ps( reject, _mm256_castsi256_ps(rejectint) );
+		
+		//Score
+		__m256 heightwidthratio{ _mm256_div_ps(
+			_mm256_cvtepi32_ps(height),
+			_mm256_cvtepi32_ps(_mm256_sub_epi32(bottomrightx, bottomleftx))) };
+		__m256 centeroffset{ _mm256_andnot_ps(_mm256_set1_ps(-0.0f), _mm256_mul_ps(
+			_mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_set1_epi32(imagewidth),
+												_mm256_add_epi32(bottomleftx,
+																 bottomrightx))),
+			_mm256_set1_ps(0.5f))) };
+		__m256 score{ _mm256_add_ps(
+			_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(constants.k_weightedheightwidth),
+										heightwidthratio),
+						  _mm256_mul_ps(_mm256_set1_ps(constants.k_weightedangleoffset),
+										angleoffset)),
+			_mm256_mul_ps(_mm256_set1_ps(constants.k_weightedcenteroffset),
+						  centeroffset)) };
+		score = _mm256_blendv_ps( score,
+								  _mm256_set1_ps(std::numeric_limits<float>::quiet_NaN()),
+								  reject );
+		_mm256_storeu_ps( scores, score );
+		return;
+	}
+#elif defined(__SSE2__)
+	const int k_pairlanes{ 4 };
+
+	//SSE2 has no signed 32 bit max or blend, built from compares and masks
+	__m128i MaxInt32( const __m128i a,
+					  const __m128i b )
+	{
+		__m128i greater{ _mm_cmpgt_epi32(a, b) };
+		return _mm_or_si128( _mm_and_si128(greater, a), _mm_andnot_si128(greater, b) );
+	}
+
+	void ScorePairLanes( const ContourTable& lefttable,
+						 const int i,
+						 const ContourTable& righttable,
+						 const int j,
+						 const int imagewidth,
+						 const LaneDetectConstants& constants,
+						 float* scores )
+	{
+		__m128 rightangle{ _mm_loadu_ps(&righttable.angle[j]) };
+		__m128 rightslopeinverse{ _mm_loadu_ps(&righttable.slopeinverse[j]) };
+		__m128i rightcenterx{ _mm_loadu_si128(
+			reinterpret_cast<const __m128i*>(&righttable.centerx[j])) };
+		__m128i rightcentery{ _mm_loadu_si128(
+			reinterpret_cast<const __m128i*>(&righttable.centery[j])) };
+		__m128i rightminy{ _mm_loadu_si128(
+			reinterpret_cast<const __m128i*>(&righttable.miny[j])) };
+		__m128i rightmaxy{ _mm_loadu_si128(
+			reinterpret_cast<const __m128i*>(&righttable.maxy[j])) };
+		__m128i rightbottomx{ _mm_loadu_si128(
+			reinterpret_cast<const __m128i*>(&righttable.bottomx[j])) };
+		float leftslopeinverse{ lefttable.slopeinverse[i] };
+		
+		//Sum angle
+		__m128 angleoffset{ _mm_mul_ps(
+			_mm_andnot_ps(_mm_set1_ps(-0.0f),
+						  _mm_sub_ps(_mm_set1_ps(180.0f - lefttable.angle[i]),
+									 rightangle)),
+			_mm_set1_ps(0.5f)) };
+		__m128 reject{ _mm_cmpgt_ps(angleoffset,
+									_mm_set1_ps(constants.k_anglefromcenter)) };
+		
+		//Left/right assignment and shape
+		__m128i rejectint{ _mm_cmpgt_epi32(_mm_set1_epi32(lefttable.centerx[i]),
+										   rightcenterx) };
+		if ( leftslopeinverse > 0.0f ) {
+			reject = _mm_or_ps( reject, _mm_cmplt_ps(rightslopeinverse, _mm_setzero_ps()) );
+		}
+		
+		//Road width and height
+		__m128i roadwidth{ _mm_sub_epi32(rightbottomx,
+										 _mm_set1_epi32(lefttable.bottomx[i])) };
+		rejectint = _mm_or_si128( rejectint, _mm_cmpgt_epi32(
+			_mm_set1_epi32(constants.k_minroadwidth), roadwidth) );
+		rejectint = _mm_or_si128( rejectint, _mm_cmpgt_epi32(
+			roadwidth, _mm_set1_epi32(constants.k_maxroadwidth)) );
+		__m128i maxy{ MaxInt32(_mm_set1_epi32(lefttable.maxy[i]), rightmaxy) };
+		__m128i miny{ MaxInt32(_mm_set1_epi32(lefttable.miny[i]), rightminy) };
+		__m128i height{ _mm_sub_epi32(maxy, miny) };
+		rejectint = _mm_or_si128( rejectint, _mm_cmpgt_epi32(
+			_mm_set1_epi32(constants.k_minimumpolygonheight), height) );
+		
+		//Bottom corners
+		__m128i bottomleftx{ _mm_cvttps_epi32(_mm_add_ps(
+			_mm_set1_ps(static_cast<float>(lefttable.centerx[i])),
+			_mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(
+						   maxy, _mm_set1_epi32(lefttable.centery[i]))),
+					   _mm_set1_ps(leftslopeinverse)))) };
+		__m128i bottomrightx{ _mm_cvttps_epi32(_mm_add_ps(
+			_mm_cvtepi32_ps(rightcenterx),
+			_mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(maxy, rightcentery)),
+					   rightslopeinverse))) };
+		rejectint = _mm_or_si128( rejectint, _mm_and_si128(
+			_mm_cmpeq_epi32(bottomleftx, _mm_setzero_si128()),
+			_mm_cmpeq_epi32(maxy, _mm_setzero_si128())) );
+		reject = _mm_or_ps( reject, _mm_castsi128_ps(rejectint) );
+		
+		//Score
+		__m128 heightwidthratio{ _mm_div_ps(
+			_mm_cvtepi32_ps(height),
+			_mm_cvtepi32_ps(_mm_sub_epi32(bottomrightx, bottomleftx))) };
+		__m128 centeroffset{ _mm_andnot_ps(_mm_set1_ps(-0.0f), _mm_mul_ps(
+			_mm_cvtepi32_ps(_mm_sub_epi32(_mm_set1_epi32(imagewidth),
+										  _mm_add_epi32(bottomleftx, bottomrightx))),
+			_mm_set1_ps(0.5f))) };
+		__m128 score{ _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(_mm_set1_ps(constants.k_weightedheightwidth),
+								  heightwidthratio),
+					   _mm_mul_ps(_mm_set1_ps(constants.k_weightedangleoffset),
+								  angleoffset)),
+			_mm_mul_ps(_mm_set1_ps(constants.k_weightedcenteroffset), centeroffset)) };
+		score = _mm_or_ps( _mm_and_ps(reject,
+									  _mm_set1_ps(std::numeric_limits<float>::quiet_NaN())),
+						   _mm_andnot_ps(reject, score) );
+		_mm_storeu_ps( scores, score );
+		return;
+	}
+#endif
+}
+
+/*****************************************************************************************/
+void ScorePairs( const ContourTable& lefttable,
+				 const int left,
+				 const ContourTable& righttable,
+				 const int first,
+				 const int count,
+				 const int imagewidth,
+				 const LaneDetectConstants& constants,
+				 float* scores )
+{
+	//Full vector blocks where available, scalar for the remainder
+	int k{0};
+#if defined(__AVX2__) || defined(__SSE2__)
+	for ( ; (k + k_pairlanes) <= count; k += k_pairlanes ) {
+		ScorePairLanes( lefttable,
+						left,
+						righttable,
+						first + k,
+						imagewidth,
+						constants,
+						scores + k );
+	}
+#endif
+	for ( ; k < count; k++ ) {
+		scores[k] = ScorePair( lefttable, left, righttable, first + k, imagewidth, constants );
+	}
+	return;
+}
+
+/*****************************************************************************************/
+int ProjectedBottomX( const EvaluatedContour& evaluatedcontour,
+					  const int imageheight )
+{
+	//Where the fitline crosses the bottom of the image
+	float slopeinverse{ evaluatedcontour.fitline[0] / evaluatedcontour.fitline[1] };
+	return static_cast<int>( evaluatedcontour.center.x +
+							 (imageheight - evaluatedcontour.center.y) * slopeinverse );
+}
+
+/*****************************************************************************************/
+SegmentKey GetSegmentKey( const LaneDetectConstants& constants )
+{
+	return SegmentKey{ constants.k_segmentminimumsize,
+					   constants.k_verticalsegmentlimit,
+					   constants.k_maxvanishingpointangle,
+					   constants.k_vanishingpointx,
+					   constants.k_vanishingpointy };
+}
+
+/*****************************************************************************************/
+SortKey GetSortKey( const LaneDetectConstants& constants )
+{
+	return SortKey{ constants.k_minimumsize,
+					constants.k_lengthwidthratio };
+}
+
+/*****************************************************************************************/
+void ProcessBlurredImageBatch( const cv::Mat& blurredimage,
+							   const std::vector<LaneDetectConstants>& candidates,
+							   std::vector<Polygon>& polygons,
+							   ProcessingCache* cache,
+							   ProcessingWorkspace* workspace )
+{
+	ProcessingWorkspace localworkspace;
+	if ( workspace == nullptr ) workspace = &localworkspace;
+	if ( cache == nullptr ) {
+		cache = &workspace->cache;
+		cache->Invalidate();
+	}
+	polygons.resize( candidates.size() );
+	
+	//Order candidates so those agreeing on upstream constants are adjacent, the cache
+	//then only reruns a stage when its key changes between neighbours
+	std::vector<int>& order{ workspace->candidateorder };
+	order.resize( candidates.size() );
+	std::iota( order.begin(), order.end(), 0 );
+	std::stable_sort( order.begin(),
+					  order.end(),
+					  [&candidates]( int lhs, int rhs )
+					  { return UpstreamOrder(candidates[lhs], candidates[rhs]); } );
+	for ( int i : order ) {
+		ProcessBlurredImage( blurredimage, candidates[i], polygons[i], cache, workspace );
+	}
+	return;
+}
+
+/*****************************************************************************************/
+bool UpstreamOrder( const LaneDetectConstants& lhs,
+					const LaneDetectConstants& rhs )
+{
+	return std::tie( lhs.k_contrastscalefactor,
+					 lhs.k_segmentminimumsize,
+					 lhs.k_verticalsegmentlimit,
+					 lhs.k_maxvanishingpointangle,
+					 lhs.k_vanishingpointx,
+					 lhs.k_vanishingpointy,
+					 lhs.k_minimumsize,
+					 lhs.k_lengthwidthratio ) <
+		   std::tie( rhs.k_contrastscalefactor,
+					 rhs.k_segmentminimumsize,
+					 rhs.k_verticalsegmentlimit,
+					 rhs.k_maxvanishingpointangle,
+					 rhs.k_vanishingpointx,
+					 rhs.k_vanishingpointy,
+					 rhs.k_minimumsize,
+					 rhs.k_lengthwidthratio );
+}
+
 /*****************************************************************************************/	
 void EvaluateSegment( const Contour& contour,
+					  const LaneDetectConstants& constants,
 					  std::vector<EvaluatedContour>& evaluatedsegments )
 {	
 	//Filter by size, only to prevent exception when creating ellipse or fitline
-	if ( contour.size() < lanedetectconstants::k_segmentminimumsize ) return;
+	if ( contour.size() < constants.k_segmentminimumsize ) return;
 		
-	//Calculate center point
-	cv::Point center { std::accumulate(contour.begin(),	contour.end(), cv::Point(0,0)) };
-	center = cv::Point(center.x / contour.size(), center.y / contour.size());
+	//Center, fitline, shape and extents in a single sweep of the points
+	ContourMoments moments;
+	ComputeContourMoments( contour, moments );
 									
 	//Filter by screen position
-	if ( center.y < (lanedetectconstants::k_verticalsegmentlimit)) return;
-
-	//Create fitline
-	cv::Vec4f fitline;
-	cv::fitLine(contour, fitline, CV_DIST_L2, 0, 0.1, 0.1 );
+	if ( moments.center.y < (constants.k_verticalsegmentlimit)) return;
 
 	//Filter by angle
-	float angle{ FastArcTan2(fitline[1], fitline[0]) };
+	float angle{ FastArcTan2(moments.fitline[1], moments.fitline[0]) };
 	if (angle < 0.0f) {
 		angle += 180.0f;
 	}
 	
 	//Check that angle points to vanishing point
-	if ( CheckAngle(center, angle) ) return;
+	if ( CheckAngle(moments.center, angle, constants) ) return;
 
-	evaluatedsegments.push_back( EvaluatedContour{contour,
+	evaluatedsegments.push_back( EvaluatedContour{static_cast<int>(contour.size()),
 	//											  ellipse,
-	//											  lengthwidthratio,
+												  moments.lengthwidthratio,
 												  angle,
-												  fitline,
-												  center} );
+												  moments.fitline,
+												  moments.center,
+												  moments.miny,
+												  moments.maxy} );
+	return;
+}
+
+/*****************************************************************************************/	
+void ComputeContourMoments( const Contour& contour,
+							ContourMoments& moments )
+{
+	//Integer sums are exact, so center and fitline agree with accumulate and fitLine
+	int64_t sumx{0};
+	int64_t sumy{0};
+	int64_t sumxx{0};
+	int64_t sumyy{0};
+	int64_t sumxy{0};
+	int miny{ contour.front().y };
+	int maxy{ contour.front().y };
+	for ( const cv::Point& point : contour ) {
+		sumx += point.x;
+		sumy += point.y;
+		sumxx += static_cast<int64_t>(point.x) * point.x;
+		sumyy += static_cast<int64_t>(point.y) * point.y;
+		sumxy += static_cast<int64_t>(point.x) * point.y;
+		miny = std::min( miny, point.y );
+		maxy = std::max( maxy, point.y );
+	}
+	int64_t count{ static_cast<int64_t>(contour.size()) };
+	moments.center = cv::Point( sumx / count, sumy / count );
+	moments.miny = miny;
+	moments.maxy = maxy;
+	
+	//Central second moments, same arithmetic as fitLine with CV_DIST_L2
+	double meanx{ static_cast<double>(sumx) / count };
+	double meany{ static_cast<double>(sumy) / count };
+	double dxx{ static_cast<double>(sumxx) / count - meanx * meanx };
+	double dyy{ static_cast<double>(sumyy) / count - meany * meany };
+	double dxy{ static_cast<double>(sumxy) / count - meanx * meany };
+	float t{ static_cast<float>(atan2(2.0 * dxy, dxx - dyy)) / 2.0f };
+	moments.fitline = cv::Vec4f( static_cast<float>(cos(t)),
+								 static_cast<float>(sin(t)),
+								 static_cast<float>(meanx),
+								 static_cast<float>(meany) );
+	
+	//Length to width from the principal axes, stands in for fitEllipse
+	double halftrace{ 0.5 * (dxx + dyy) };
+	double spread{ sqrt(0.25 * (dxx - dyy) * (dxx - dyy) + dxy * dxy) };
+	double minoraxis{ halftrace - spread };
+	if ( minoraxis > 0.0 ) {
+		moments.lengthwidthratio = static_cast<float>( sqrt((halftrace + spread) / minoraxis) );
+	} else {
+		moments.lengthwidthratio = std::numeric_limits<float>::max();
+	}
 	return;
 }
 
 /*****************************************************************************************/	
 bool CheckAngle( const cv::Point center,
-				 const float angle )
+				 const float angle,
+				 const LaneDetectConstants& constants )
 {
 	//Get angle fron contour center to vanishing point
-	float vanishingpointangle{ FastArcTan2((lanedetectconstants::k_vanishingpointy -
+	float vanishingpointangle{ FastArcTan2((constants.k_vanishingpointy -
 											 center.y),
-											(lanedetectconstants::k_vanishingpointx -
+											(constants.k_vanishingpointx -
 											 center.x)) };
 	if (vanishingpointangle < 0.0f) {
 		vanishingpointangle += 180.0f;
@@ -239,7 +1317,7 @@ bool CheckAngle( const cv::Point center,
 
 	//Check difference against limit and return result
 	if ( fabs(angle - vanishingpointangle) >
-		 lanedetectconstants::k_maxvanishingpointangle ) {
+		 constants.k_maxvanishingpointangle ) {
 		return true;
 	} else {
 		return false;
@@ -249,19 +1327,12 @@ bool CheckAngle( const cv::Point center,
 /*****************************************************************************************/
 void SortContours( const std::vector<EvaluatedContour>& evaluatedsegments,
                    const int imagewidth,
+				   const LaneDetectConstants& constants,
 				   std::vector<EvaluatedContour>& leftcontours,
 				   std::vector<EvaluatedContour>& rightcontours )
 {
 	for ( const EvaluatedContour &evaluatedcontour : evaluatedsegments ) {
-		//Filter by length
-		if ( evaluatedcontour.contour.size() < lanedetectconstants::k_minimumsize ) {
-			continue;
-		}
-		
-		//Filter by length to width ratio - removes non-linear lines	
-		cv::RotatedRect ellipse{ fitEllipse(evaluatedcontour.contour) };
-		float lengthwidthratio{ ellipse.size.height / ellipse.size.width };
-		if ( lengthwidthratio < lanedetectconstants::k_lengthwidthratio ) {
+		if ( !KeepContour(evaluatedcontour, constants) ) {
 			continue;
 		}
 		
@@ -276,11 +1347,28 @@ void SortContours( const std::vector<EvaluatedContour>& evaluatedsegments,
 	return;
 }
 
+/*****************************************************************************************/
+bool KeepContour( const EvaluatedContour& evaluatedcontour,
+				  const LaneDetectConstants& constants )
+{
+	//Filter by length
+	if ( evaluatedcontour.pointcount < constants.k_minimumsize ) {
+		return false;
+	}
+	
+	//Filter by length to width ratio - removes non-linear lines	
+	if ( evaluatedcontour.lengthwidthratio < constants.k_lengthwidthratio ) {
+		return false;
+	}
+	return true;
+}
+
 /*****************************************************************************************/
 void FindPolygon( Polygon& polygon,
                   const EvaluatedContour& leftevaluatedcontour,
 				  const EvaluatedContour& rightevaluatedcontour,
                   const int imageheight,
+				  const LaneDetectConstants& constants,
 				  bool useoptimaly )
 {
 	//Check for correct left/right assignment
@@ -294,33 +1382,21 @@ void FindPolygon( Polygon& polygon,
 	if ( (leftslopeinverse > 0.0f) && (rightslopeinverse < 0.0f) ) return;
 	
 	//Calculate optimal bottom points
-	cv::Point bottomleftoptimal{ cv::Point(leftevaluatedcontour.center.x + 
-										   (imageheight - leftevaluatedcontour.center.y) *
-										   leftslopeinverse,
+	cv::Point bottomleftoptimal{ cv::Point(ProjectedBottomX(leftevaluatedcontour,
+															imageheight),
 										   imageheight) };
-	cv::Point bottomrightoptimal{ cv::Point(rightevaluatedcontour.center.x +
-										    (imageheight - rightevaluatedcontour.center.y) *
-											rightslopeinverse,
+	cv::Point bottomrightoptimal{ cv::Point(ProjectedBottomX(rightevaluatedcontour,
+															 imageheight),
 											imageheight) };
 	
 	//Perform filtering based on width of polygon with optimal maxy
 	int roadwidth{ bottomrightoptimal.x - bottomleftoptimal.x };
-	if ( roadwidth < lanedetectconstants::k_minroadwidth ) return;
-	if ( roadwidth > lanedetectconstants::k_maxroadwidth ) return;
+	if ( roadwidth < constants.k_minroadwidth ) return;
+	if ( roadwidth > constants.k_maxroadwidth ) return;
 	
 	//Get point extremes
-	auto minmaxyleft = std::minmax_element( leftevaluatedcontour.contour.begin(),
-											leftevaluatedcontour.contour.end(),
-											[]( const cv::Point& lhs,
-												const cv::Point& rhs )
-											{ return lhs.y < rhs.y; } );
-	auto minmaxyright = std::minmax_element( rightevaluatedcontour.contour.begin(),
-											 rightevaluatedcontour.contour.end(),
-											 []( const cv::Point& lhs,
-												 const cv::Point& rhs )
-											 { return lhs.y < rhs.y; } );
-	int maxyactual{ std::max(minmaxyleft.second->y, minmaxyright.second->y) };
-	int miny{ std::max(minmaxyleft.first->y, minmaxyright.first->y) };
+	int maxyactual{ std::max(leftevaluatedcontour.maxy, rightevaluatedcontour.maxy) };
+	int miny{ std::max(leftevaluatedcontour.miny, rightevaluatedcontour.miny) };
 	int maxy;	
 	if ( useoptimaly ) {
 		maxy = imageheight;
@@ -329,7 +1405,7 @@ void FindPolygon( Polygon& polygon,
 	}
 	
 	//Filter by height
-	if ( (maxyactual - miny) < lanedetectconstants::k_minimumpolygonheight ) return;
+	if ( (maxyactual - miny) < constants.k_minimumpolygonheight ) return;
 	
 	//Construct polygon
 	if ( useoptimaly ) {
@@ -361,7 +1437,8 @@ void FindPolygon( Polygon& polygon,
 float Score( const Polygon& polygon,
              const EvaluatedContour& leftevaluatedcontour,
 			 const EvaluatedContour& rightevaluatedcontour,
-			 const int imagewidth )
+			 const int imagewidth,
+			 const LaneDetectConstants& constants )
 {
 	
 	float heightwidthratio{ static_cast<float>(polygon[0].y - polygon[3].y) /
@@ -373,92 +1450,9 @@ float Score( const Polygon& polygon,
 								   leftevaluatedcontour.angle -
 								   rightevaluatedcontour.angle) };
 	
-	return lanedetectconstants::k_weightedheightwidth * heightwidthratio +
-		   lanedetectconstants::k_weightedangleoffset * angleoffset +
-		   lanedetectconstants::k_weightedcenteroffset * centeroffset;
-}
-
-/*****************************************************************************************/
-void AveragePolygon ( Polygon& polygon,
-                      std::deque<Polygon>& pastpolygons,
-					  int samplestoaverage,
-					  int samplestokeep )
-{
-	//FIFO
-	pastpolygons.push_back( polygon );
-	if ( pastpolygons.size() > samplestokeep ) {
-		pastpolygons.pop_front();
-	}
-
-	//Sum nonzero
-	Polygon averagepolygon { cv::Point(0,0),
-							 cv::Point(0,0),
-							 cv::Point(0,0),
-							 cv::Point(0,0) };
-	int nonzerocount{0};
-	for ( Polygon &ipolygon : pastpolygons ) {
-		if ( ipolygon[0] == cv::Point(0,0) ) continue;
-		nonzerocount++;
-		for ( int i = 0; i < ipolygon.size(); i++ ) {
-			averagepolygon[i].x += ipolygon[i].x;
-			averagepolygon[i].y += ipolygon[i].y;
-		}
-	}	
-	if ( nonzerocount == 0 ) return;
-
-	//Average nonzero
-	for ( int i = 0; i < polygon.size(); i++ ) {
-		averagepolygon[i].x /= nonzerocount;
-		averagepolygon[i].y /= nonzerocount;
-	}
-	
-	//if not enough nonzero polygons, return
-	if ( nonzerocount < samplestoaverage ) {
-		std::copy( std::begin(averagepolygon),
-				   std::end(averagepolygon),
-				   std::begin(polygon) );
-		return;
-	}
-
-	//Find differences
-	std::vector<PolygonDifferences> polygondifferences;
-	for ( Polygon &ipolygon : pastpolygons ) {
-		float differencefromaverage{0.0f};
-		for ( int i = 0; i < ipolygon.size(); i++ ) {
-			differencefromaverage += fabs(averagepolygon[i].x - ipolygon[i].x);
-			differencefromaverage += fabs(averagepolygon[i].y - ipolygon[i].y);
-		}
-		polygondifferences.push_back( PolygonDifferences { ipolygon,
-														   differencefromaverage } );
-	}
-
-	//Sort
-	sort( polygondifferences.begin(),
-		  polygondifferences.end(),
-		  [](const PolygonDifferences& a,
-			 const PolygonDifferences& b )
-		  { return a.differencefromaverage < b.differencefromaverage; } );
-
-	//Sum closest values
-	averagepolygon = { cv::Point(0,0),
-					   cv::Point(0,0),
-					   cv::Point(0,0),
-					   cv::Point(0,0) };
-	for ( int i = 0; i < samplestoaverage; i++ ) {
-		for (int j = 0; j < 4; j++) {
-			averagepolygon[j].x += polygondifferences[i].polygon[j].x;
-			averagepolygon[j].y += polygondifferences[i].polygon[j].y;
-		}
-	}
-	//Average closest values
-	for ( int i = 0; i < polygon.size(); i++ ) {
-		averagepolygon[i].x /= samplestoaverage;
-		averagepolygon[i].y /= samplestoaverage;
-	}
-	std::copy( std::begin(averagepolygon),
-			   std::end(averagepolygon),
-			   std::begin(polygon));
-	return;
+	return constants.k_weightedheightwidth * heightwidthratio +
+		   constants.k_weightedangleoffset * angleoffset +
+		   constants.k_weightedcenteroffset * centeroffset;
 }
 
 /*****************************************************************************************/
@@ -16,53 +16,240 @@
 #define LANEDETECTPROCESSOR_H
 
 //Standard libraries
-#include <deque>
 #include <array>
 
 //3rd party libraries
 #include "opencv2/opencv.hpp"
 
+//Project libraries
+#include "lane_detect_constants.h"
+
 /*****************************************************************************************/
 typedef std::array<cv::Point, 4> Polygon;
 typedef std::vector<cv::Point> Contour;
 
+//Metadata of one contour, everything later stages need is gathered here so evaluating
+//and sorting never copies the points
 struct EvaluatedContour {
-    Contour contour;
+	int pointcount;
     //cv::RotatedRect ellipse;
-    //float lengthwidthratio;
+    float lengthwidthratio;
 	float angle;
     cv::Vec4f fitline;
 	cv::Point center;
+	int miny;
+	int maxy;
+};
+
+//Everything later stages need from a contour's points, gathered in one pass
+struct ContourMoments {
+	cv::Point center;
+	cv::Vec4f fitline;
+	float lengthwidthratio;
+	int miny;
+	int maxy;
+};
+
+//Constants read by EvaluateSegment and CheckAngle
+struct SegmentKey {
+	uint16_t segmentminimumsize;
+	uint16_t verticalsegmentlimit;
+	float maxvanishingpointangle;
+	uint16_t vanishingpointx;
+	uint16_t vanishingpointy;
+	bool operator==( const SegmentKey& rhs ) const {
+		return segmentminimumsize == rhs.segmentminimumsize &&
+			   verticalsegmentlimit == rhs.verticalsegmentlimit &&
+			   maxvanishingpointangle == rhs.maxvanishingpointangle &&
+			   vanishingpointx == rhs.vanishingpointx &&
+			   vanishingpointy == rhs.vanishingpointy;
+	}
+};
+
+//Constants read by SortContours
+struct SortKey {
+	uint16_t minimumsize;
+	float lengthwidthratio;
+	bool operator==( const SortKey& rhs ) const {
+		return minimumsize == rhs.minimumsize &&
+			   lengthwidthratio == rhs.lengthwidthratio;
+	}
+};
+
+//Structure of arrays copy of the evaluated contour fields the pair search reads, so
+//that several right contours can be tested against one left contour at once
+struct ContourTable {
+	std::vector<int> index;
+	std::vector<int> centerx;
+	std::vector<int> centery;
+	std::vector<float> slopeinverse;
+	std::vector<float> angle;
+	std::vector<int> miny;
+	std::vector<int> maxy;
+	std::vector<int> bottomx;
+};
+
+//Left contours in their own order, right contours ordered by angle and by projected
+//bottom x, so the pair search for a left contour only visits the windows that can pass
+//its angle and road width checks
+struct PairSearchIndex {
+	ContourTable left;
+	ContourTable rightbyangle;
+	ContourTable rightbybottomx;
+};
+
+//Per frame results of each ProcessBlurredImage stage.  A stage is rerun only when the
+//constants it reads change, which invalidates every stage after it.
+struct ProcessingCache {
+	bool statsvalid{false};
+	double standarddeviation{0.0};
+	int imagewidth{0};
+	int imageheight{0};
+	bool contoursvalid{false};
+	float contrastscalefactor{0.0f};
+	int roitop{0};
+	std::vector<Contour> detectedcontours;
+	std::vector<cv::Vec4i> detectedhierarchy;
+	bool segmentsvalid{false};
+	SegmentKey segmentkey;
+	std::vector<EvaluatedContour> evaluatedchildsegments;
+	std::vector<EvaluatedContour> evaluatedparentsegments;
+	bool sortedvalid{false};
+	SortKey sortkey;
+	std::vector<EvaluatedContour> leftcontours;
+	std::vector<EvaluatedContour> rightcontours;
+	PairSearchIndex pairindex;
+	void Invalidate() {
+		statsvalid = false;
+		contoursvalid = false;
+		segmentsvalid = false;
+		sortedvalid = false;
+	}
 };
 
-struct PolygonDifferences {
-	Polygon polygon;
-	float differencefromaverage;
+//Scratch buffers reused frame to frame by one thread, so that in steady state the
+//pipeline makes no large allocations
+struct ProcessingWorkspace {
+	cv::Mat grayimage;
+	cv::Mat downscaledimage;
+	cv::Mat blurredimage;
+	cv::Mat edgeimage;
+	cv::Mat bandmask;
+	std::vector<Contour> bandcontours;
+	std::vector<cv::Vec4i> bandhierarchy;
+	ProcessingCache cache;
+	std::vector<uint16_t> columnsums;
+	std::vector<int> candidateorder;
+	std::vector<Polygon> polygons;
 };
 
+void ComputeContourMoments( const Contour& contour,
+							ContourMoments& moments );
 void EvaluateSegment( const Contour& contour,
+					  const LaneDetectConstants& constants,
 	                  std::vector<EvaluatedContour>& evaluatedsegments );
 bool CheckAngle( const cv::Point center,
-				 const float angle );
+				 const float angle,
+				 const LaneDetectConstants& constants );
 void SortContours( const std::vector<EvaluatedContour>& evaluatedsegments,
 				   const int imagewidth,
+				   const LaneDetectConstants& constants,
 				   std::vector<EvaluatedContour>& leftcontours,
 				   std::vector<EvaluatedContour>& rightcontours );
+bool KeepContour( const EvaluatedContour& evaluatedcontour,
+				  const LaneDetectConstants& constants );
 void FindPolygon( Polygon& polygon,
                   const EvaluatedContour& leftevaluatedcontour,
 				  const EvaluatedContour& rightevaluatedcontour,
                   const int imageheight,
+				  const LaneDetectConstants& constants,
 				  bool useoptimaly = false );
 float Score( const Polygon& polygon,
              const EvaluatedContour& leftevaluatedcontour,
 			 const EvaluatedContour& rightevaluatedcontour,
-			 const int imagewidth );
-void AveragePolygon( Polygon& polygon,
-					 std::deque<Polygon>& pastpolygons,
-					 int samplestoaverage,
-					 int samplestokeep );
-void ProcessImage( cv::Mat& image,
-				   Polygon& polygon );
+			 const int imagewidth,
+			 const LaneDetectConstants& constants );
+void ProcessImage( const cv::Mat& image,
+				   const LaneDetectConstants& constants,
+				   Polygon& polygon,
+				   ProcessingWorkspace* workspace = nullptr );
+void ProcessImageLuma( const uchar* luma,
+					   const int width,
+					   const int height,
+					   const size_t stride,
+					   const LaneDetectConstants& constants,
+					   Polygon& polygon,
+					   ProcessingWorkspace* workspace = nullptr );
+void PreprocessImage( const cv::Mat& image,
+					  cv::Mat& blurredimage,
+					  ProcessingWorkspace* workspace = nullptr,
+					  ProcessingCache* cache = nullptr,
+					  const int downscale = 1 );
+const LaneDetectConstants& ScaleLaneDetectConstants( const LaneDetectConstants& constants,
+													 const cv::Size imagesize,
+													 LaneDetectConstants& scaledconstants );
+bool PreprocessImageFused( const cv::Mat& image,
+						   cv::Mat& blurredimage,
+						   ProcessingWorkspace& workspace,
+						   double* standarddeviation );
+void ProcessBlurredImage( const cv::Mat& blurredimage,
+						  const LaneDetectConstants& constants,
+						  Polygon& polygon,
+						  ProcessingCache* cache = nullptr,
+						  ProcessingWorkspace* workspace = nullptr );
+void ProcessBlurredImageTracked( const cv::Mat& blurredimage,
+								 const LaneDetectConstants& constants,
+								 const Polygon& predictedpolygon,
+								 Polygon& polygon,
+								 ProcessingWorkspace* workspace = nullptr );
+void FindBandContours( const cv::Mat& blurredimage,
+					   const double standarddeviation,
+					   const LaneDetectConstants& constants,
+					   const cv::Point& linetop,
+					   const cv::Point& linebottom,
+					   ProcessingWorkspace& workspace );
+void FindContours( const cv::Mat& blurredimage,
+				   const double standarddeviation,
+				   const LaneDetectConstants& constants,
+				   cv::Mat& edgeimage,
+				   std::vector<Contour>& detectedcontours,
+				   std::vector<cv::Vec4i>& detectedhierarchy );
+int RoiTop( const LaneDetectConstants& constants,
+			const int imageheight );
+void FindBestPolygon( const std::vector<EvaluatedContour>& leftcontours,
+					  const std::vector<EvaluatedContour>& rightcontours,
+					  const PairSearchIndex& pairindex,
+					  const int imagewidth,
+					  const int imageheight,
+					  const LaneDetectConstants& constants,
+					  Polygon& polygon );
+void BuildPairSearchIndex( const std::vector<EvaluatedContour>& leftcontours,
+						   const std::vector<EvaluatedContour>& rightcontours,
+						   const int imageheight,
+						   PairSearchIndex& pairindex );
+void BuildContourTable( const std::vector<EvaluatedContour>& evaluatedcontours,
+						const std::vector<int>& order,
+						const int imageheight,
+						ContourTable& table );
+void ScorePairs( const ContourTable& lefttable,
+				 const int left,
+				 const ContourTable& righttable,
+				 const int first,
+				 const int count,
+				 const int imagewidth,
+				 const LaneDetectConstants& constants,
+				 float* scores );
+int ProjectedBottomX( const EvaluatedContour& evaluatedcontour,
+					  const int imageheight );
+void ProcessBlurredImageBatch( const cv::Mat& blurredimage,
+							   const std::vector<LaneDetectConstants>& candidates,
+							   std::vector<Polygon>& polygons,
+							   ProcessingCache* cache = nullptr,
+							   ProcessingWorkspace* workspace = nullptr );
+bool UpstreamOrder( const LaneDetectConstants& lhs,
+					const LaneDetectConstants& rhs );
+SegmentKey GetSegmentKey( const LaneDetectConstants& constants );
+SortKey GetSortKey( const LaneDetectConstants& constants );
 float FastArcTan2( const float y,
 				   const float x );
 
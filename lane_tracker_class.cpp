@@ -0,0 +1,105 @@
+#include <math.h>
+#include "opencv2/opencv.hpp"
+#include "lane_tracker_class.h"
+#include "lane_detect_processor.h"
+
+namespace {
+	//Consecutive full frame detections before the bands are trusted, at least two so
+	//there is a velocity to predict with
+	const int k_acquireframes{ 3 };
+	
+	//Average corner distance
+	double Deviation( const Polygon& polygon,
+					  const Polygon& predictedpolygon )
+	{
+		double distance{0.0};
+		for ( int i = 0; i < polygon.size(); i++ ) {
+			cv::Point offset{ polygon[i] - predictedpolygon[i] };
+			distance += sqrt( static_cast<double>(offset.x * offset.x + offset.y * offset.y) );
+		}
+		return distance / polygon.size();
+	}
+}
+
+LaneTracker::LaneTracker():
+						 tracking_{false},
+						 trackedframes_{0},
+						 fallbackframes_{0},
+						 consecutivedetections_{0}
+{
+}
+
+void LaneTracker::Process( const cv::Mat& image,
+						   const LaneDetectConstants& constants,
+						   Polygon& polygon )
+{
+	PreprocessImage( image,
+					 workspace_.blurredimage,
+					 &workspace_,
+					 &workspace_.cache,
+					 constants.k_downscale );
+
+	if ( tracking_ ) {
+		Polygon predictedpolygon;
+		Predict( predictedpolygon );
+		ProcessBlurredImageTracked( workspace_.blurredimage,
+									constants,
+									predictedpolygon,
+									polygon,
+									&workspace_ );
+		LaneDetectConstants scaledconstants;
+		const LaneDetectConstants& imageconstants{ ScaleLaneDetectConstants(constants,
+																		   image.size(),
+																		   scaledconstants) };
+		if ( (polygon[0] != cv::Point(0,0)) &&
+			 (Deviation(polygon, predictedpolygon) <= imageconstants.k_trackingmaxdeviation) ) {
+			trackedframes_++;
+			Record( polygon );
+			return;
+		}
+
+		//Lost or not trusted, image statistics are kept and the rest is redone over the
+		//whole frame
+		fallbackframes_++;
+		tracking_ = false;
+		consecutivedetections_ = 0;
+	}
+
+	ProcessBlurredImage( workspace_.blurredimage,
+						 constants,
+						 polygon,
+						 &workspace_.cache,
+						 &workspace_ );
+	if ( polygon[0] != cv::Point(0,0) ) {
+		Record( polygon );
+	} else {
+		consecutivedetections_ = 0;
+	}
+
+	return;
+}
+
+void LaneTracker::Reset()
+{
+	tracking_ = false;
+	consecutivedetections_ = 0;
+	return;
+}
+
+void LaneTracker::Predict( Polygon& predictedpolygon ) const
+{
+	//Constant velocity, one frame ahead
+	for ( int i = 0; i < predictedpolygon.size(); i++ ) {
+		predictedpolygon[i] = lastpolygon_[i] + (lastpolygon_[i] - previouspolygon_[i]);
+	}
+	return;
+}
+
+void LaneTracker::Record( const Polygon& polygon )
+{
+	previouspolygon_ = lastpolygon_;
+	lastpolygon_ = polygon;
+	consecutivedetections_++;
+	tracking_ = consecutivedetections_ >= k_acquireframes;
+	return;
+}
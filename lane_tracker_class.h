@@ -0,0 +1,37 @@
+#ifndef LANETRACKER_H
+#define LANETRACKER_H
+
+#include "opencv2/opencv.hpp"
+#include "lane_detect_constants.h"
+#include "lane_detect_processor.h"
+
+//Follows the lane from frame to frame for live use, frames must be given in order.
+//Once the lane has been found in k_acquireframes frames in a row, each corner of the
+//next polygon is predicted to keep moving at its last velocity and only bands around
+//the predicted lane lines are searched.  A frame where the bands hold no lane, or only
+//one too far from the prediction to trust, is searched again over the whole frame, and
+//tracking restarts from there.
+class LaneTracker
+{
+	public:
+		LaneTracker();
+		void Process( const cv::Mat& image,
+					  const LaneDetectConstants& constants,
+					  Polygon& polygon );
+		void Reset();
+		bool tracking_;
+		uint32_t trackedframes_;
+		uint32_t fallbackframes_;
+
+	protected:
+
+	private:
+		void Predict( Polygon& predictedpolygon ) const;
+		void Record( const Polygon& polygon );
+		ProcessingWorkspace workspace_;
+		Polygon lastpolygon_;
+		Polygon previouspolygon_;
+		int consecutivedetections_;
+};
+
+#endif // LANETRACKER_H
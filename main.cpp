@@ -28,11 +28,15 @@
 #include <fstream>
 #include <string>
 #include <vector>
-#include <queue>
 #include <thread>
 #include <mutex>
 #include <atomic>
 #include <chrono>
+#include <algorithm>
+#include <numeric>
+#include <memory>
+#include <sstream>
+#include <cstring>
 
 //3rd party libraries
 #include "opencv2/opencv.hpp"
@@ -42,18 +46,208 @@
 #include "lane_detect_processor.h"
 #include "lane_constant_class.h"
 #include "result_values_class.h"
+#include "frame_cache_class.h"
+#include "thread_pool_class.h"
+#include "frame_queue_class.h"
+#include "frame_pool_class.h"
+#include "frame_reader_class.h"
+#include "optimizer_class.h"
+#include "result_cache_class.h"
+#include "worker_coordinator_class.h"
+#include "frame_log_class.h"
+#include "label_store_class.h"
+#include "stage_cache_class.h"
+#include "lane_tracker_class.h"
 
 /*****************************************************************************************/
+//Frames per thread pool task
+const int k_framesperchunk{ 16 };
+
+//Decoded bytes allowed in flight between FrameLoaderThread and the processing loop
+const uint64_t k_queuebytes{ 256 * 1024 * 1024 };
+
+//Fewest frames the first rung of successive halving may rank candidates on
+const uint32_t k_minimumrungframes{ 200 };
+
+//Frames evaluated by one rung of successive halving, by index over all files.  Every
+//stride'th frame, less those an earlier rung with previousstride already evaluated, so
+//each rung is spread evenly over every file and survivors see each frame once.
+struct FrameSubset {
+	uint32_t stride;
+	uint32_t previousstride;
+	bool Contains( uint32_t frameindex ) const {
+		return ( (frameindex % stride) == 0 ) &&
+			   ( (previousstride == 0) || ((frameindex % previousstride) != 0) );
+	}
+	uint32_t Count( uint32_t totalframes ) const {
+		uint32_t count{ (totalframes + stride - 1) / stride };
+		if ( previousstride > 0 ) count -= (totalframes + previousstride - 1) / previousstride;
+		return count;
+	}
+};
+
+//Everything a pass over the frames needs besides its candidates
+struct EvaluationSetup {
+	const std::vector<std::string>& filenames;
+	const std::vector<uint32_t>& filestarts;
+	const RawVideoFormat& rawformat;
+	const FrameCache& framecache;
+	StageCache& stagecache;
+	const uint32_t totalframes;
+	const int halving;
+	const ResultValues& emptyresults;
+	ThreadPool& threadpool;
+	ResultCache& resultcache;
+	WorkerCoordinator* coordinator;
+	FrameLogWriter* framelog;
+};
+
 //Forward declations
-void UpdateLaneConstants(std::vector<LaneConstant> &laneconstants);
-void FrameLoaderThread( cv::VideoCapture* videocapture,
-						std::mutex* framesmutex,
-						std::queue<cv::Mat>* frames,
-						std::atomic<bool>* done);
+void EvaluateBatch( const EvaluationSetup& setup,
+					const std::vector<LaneDetectConstants>& candidates,
+					const std::vector< std::vector<double> >& candidatevalues,
+					const std::string& variablename,
+					const uint64_t firstiteration,
+					std::vector<ResultRecord>& records );
+int EvaluatePass( const EvaluationSetup& setup,
+				  const std::vector<LaneDetectConstants>& candidates,
+				  const std::string& variablename,
+				  std::vector<ResultValues>& candidateresults,
+				  std::vector<int>& candidaterungs );
+void RunOptimizer( const EvaluationSetup& setup,
+				   Optimizer& optimizer,
+				   const int passes,
+				   const int batchsize,
+				   const LaneDetectConstants& defaultconstants,
+				   std::ofstream& resultsfile,
+				   double& maxmatcherror );
+void WriteResultRow( std::ofstream& resultsfile,
+					 const int iteration,
+					 const std::vector<double>& values,
+					 const ResultRecord& record );
+void SaveCheckpoint( ResultCache& resultcache,
+					 const int iterationcount );
+void UpdateLaneConstants( const std::vector<LaneConstant> &laneconstants,
+						  LaneDetectConstants& constants );
+void EvaluateCandidates( const std::vector<std::string>& filenames,
+						 const std::vector<uint32_t>& filestarts,
+						 const RawVideoFormat& rawformat,
+						 const FrameCache& framecache,
+						 StageCache& stagecache,
+						 const std::vector<LaneDetectConstants>& candidates,
+						 const uint32_t totalframes,
+						 const FrameSubset& subset,
+						 const std::string& variablename,
+						 ThreadPool& threadpool,
+						 WorkerCoordinator* coordinator,
+						 std::vector<ResultValues>& candidateresults );
+void ReplayTracker( const std::vector<std::string>& filenames,
+					const RawVideoFormat& rawformat,
+					const std::vector<uint32_t>& filestarts,
+					const LaneDetectConstants& constants,
+					ResultValues& results );
+void FrameLoaderThread( FrameReader* framereader,
+						FramePool* framepool,
+						FrameQueue* frames );
 int main(int argc,char *argv[])
 {
+	//Split arguments into options and video files
+	uint64_t cachebudgetmb{4096};
+	bool usestore{true};
+	bool usestagecache{true};
+	bool usebatch{true};
+	bool validatematch{false};
+	bool useroi{false};
+	int roimargin{-1};
+	int downscale{1};
+	int threadcount{0};
+	int halving{0};
+	std::string optimizername;
+	int passes{20};
+	int batchsize{0};
+	uint64_t seed{1};
+	bool resume{false};
+	std::string checkpointfilename{ "resultsfile.ldcheckpoint" };
+	int processcount{1};
+	std::string framelogfilename;
+	bool track{false};
+	RawVideoFormat rawformat{ cv::Size(0,0), YuvFormat::kNv12 };
+	std::vector<std::string> filenames;
+	for (int i = 1; i < argc; i++ ) {
+		std::string argument{ argv[i] };
+		if ( argument.compare(0, 10, "--cachemb=") == 0 ) {
+			cachebudgetmb = std::stoull( argument.substr(10) );
+		} else if ( argument == "--nostore" ) {
+			usestore = false;
+		} else if ( argument == "--nostagecache" ) {
+			usestagecache = false;
+		} else if ( argument == "--nobatch" ) {
+			usebatch = false;
+		} else if ( argument == "--validatematch" ) {
+			validatematch = true;
+		} else if ( argument == "--roi" ) {
+			useroi = true;
+		} else if ( argument.compare(0, 12, "--roimargin=") == 0 ) {
+			useroi = true;
+			roimargin = std::stoi( argument.substr(12) );
+		} else if ( argument.compare(0, 10, "--yuvsize=") == 0 ) {
+			size_t separator{ argument.find('x', 10) };
+			if ( separator != std::string::npos ) {
+				rawformat.framesize = cv::Size( std::stoi(argument.substr(10, separator - 10)),
+												std::stoi(argument.substr(separator + 1)) );
+			}
+		} else if ( argument.compare(0, 12, "--yuvformat=") == 0 ) {
+			if ( !FrameReader::ParseYuvFormat(argument.substr(12), rawformat.format) ) {
+				std::cout << "Unknown yuv format, expected nv12 or i420" << std::endl;
+				return 0;
+			}
+		} else if ( argument.compare(0, 12, "--downscale=") == 0 ) {
+			downscale = std::max( std::stoi(argument.substr(12)), 1 );
+		} else if ( argument.compare(0, 10, "--threads=") == 0 ) {
+			threadcount = std::stoi( argument.substr(10) );
+		} else if ( argument == "--halving" ) {
+			halving = 3;
+		} else if ( argument.compare(0, 10, "--halving=") == 0 ) {
+			halving = std::max( std::stoi(argument.substr(10)), 2 );
+		} else if ( argument.compare(0, 12, "--optimizer=") == 0 ) {
+			optimizername = argument.substr(12);
+		} else if ( argument.compare(0, 9, "--passes=") == 0 ) {
+			passes = std::max( std::stoi(argument.substr(9)), 1 );
+		} else if ( argument.compare(0, 12, "--batchsize=") == 0 ) {
+			batchsize = std::max( std::stoi(argument.substr(12)), 1 );
+		} else if ( argument.compare(0, 7, "--seed=") == 0 ) {
+			seed = std::stoull( argument.substr(7) );
+		} else if ( argument.compare(0, 12, "--processes=") == 0 ) {
+			processcount = std::max( std::stoi(argument.substr(12)), 1 );
+		} else if ( argument == "--framelog" ) {
+			framelogfilename = "resultsfile.ldframes";
+		} else if ( argument.compare(0, 11, "--framelog=") == 0 ) {
+			framelogfilename = argument.substr(11);
+		} else if ( argument == "--track" ) {
+			track = true;
+		} else if ( argument == "--resume" ) {
+			resume = true;
+		} else if ( argument.compare(0, 13, "--checkpoint=") == 0 ) {
+			checkpointfilename = argument.substr(13);
+		} else {
+			filenames.push_back( argument );
+		}
+	}
+	
+	//Worker processes are forked once frames are loaded, OpenCV must not have started a
+	//thread pool of its own by then.  Frames are spread over threads by the learner
+	//itself anyway.
+	if ( processcount > 1 ) cv::setNumThreads( 1 );
+	
+	//Tracking replays every frame in order as it arrives, nothing is cached
+	if ( track ) {
+		cachebudgetmb = 0;
+		usestore = false;
+		processcount = 1;
+	}
+	
 	//Check arguments passed
-	if (argc < 2) {
+	if (filenames.empty()) {
 		std::cout << "No arguments passed, press ENTER to exit..." << std::endl;
 		std::cin.get();
 		return 0;
@@ -70,54 +264,117 @@ int main(int argc,char *argv[])
 		
 	
 	
-	//Find total frames in all video files
+	//Find total frames in all video files,
+	//and the frame size the match target is scaled to
 	uint32_t totalframes{0};
-	for (int i = 1; i < argc; i++ ) {
-		cv::VideoCapture capture(argv[i]);
-		totalframes += capture.get(cv::CAP_PROP_FRAME_COUNT);
-		capture.release();
-		resultsfile << argv[i] << std::endl;
+	cv::Size framesize{ 0, 0 };
+	std::vector<int> fileframecounts;
+	for (int i = 0; i < filenames.size(); i++ ) {
+		FrameReader reader( filenames[i], rawformat );
+		totalframes += reader.FrameCount();
+		fileframecounts.push_back( reader.ReadableFrames() );
+		if ( reader.IsOpened() ) {
+			if ( framesize.area() == 0 ) {
+				framesize = reader.FrameSize();
+			} else if ( (reader.FrameSize().width != framesize.width) ||
+						(reader.FrameSize().height != framesize.height) ) {
+				std::cout << filenames[i] << " differs in size, matched against a target "
+						  << "for " << framesize.width << "x" << framesize.height << std::endl;
+			}
+		}
+		reader.Release();
+		resultsfile << filenames[i] << std::endl;
 	}
+	if ( framesize.area() == 0 ) framesize = cv::Size( k_referencewidth, k_referenceheight );
 	resultsfile << std::endl;
-	std::cout << (argc - 1) << " files to evaluate with " << totalframes <<
+	std::cout << filenames.size() << " files to evaluate with " << totalframes <<
 		" total frames" << std::endl;
-	//Set how often to message console
-	uint32_t messagecount{totalframes/100};	//Every 1%
+	
+	//Decode everything once, grayscale and blur don't depend on any constant
+	FrameCache framecache{ cachebudgetmb * 1024 * 1024, usestore, rawformat, downscale };
+	framecache.Load( filenames );
+	
+	//Stage results of every cached frame, so only stages whose constants changed rerun.
+	//They share the budget with the frames held in memory.
+	uint64_t stagecachebytes{0};
+	if ( usestagecache && (cachebudgetmb * 1024 * 1024 > framecache.usedbytes_) ) {
+		stagecachebytes = cachebudgetmb * 1024 * 1024 - framecache.usedbytes_;
+	}
+	
+	//Frames are indexed over all files in the order they are evaluated, first index of
+	//each file
+	std::vector<uint32_t> filestarts;
+	uint32_t filestart{0};
+	for ( int i = 0; i < filenames.size(); i++ ) {
+		filestarts.push_back( filestart );
+		filestart += framecache.IsCached(i) ? framecache.Frames(i).size() :
+					 fileframecounts[i];
+	}
+	
+	//Worker processes take over the cached frames.  Forked before the learner starts any
+	//thread, each inherits the frames and builds stage caches within its share of the
+	//budget.
+	WorkerCoordinator coordinator;
+	if ( processcount > 1 ) {
+		std::vector<cv::Mat> cachedframes;
+		for ( int i = 0; i < filenames.size(); i++ ) {
+			if ( !framecache.IsCached(i) ) continue;
+			cachedframes.insert( cachedframes.end(),
+								 framecache.Frames(i).begin(),
+								 framecache.Frames(i).end() );
+		}
+		if ( coordinator.Start(processcount, cachedframes, stagecachebytes) ) {
+			std::cout << coordinator.workercount_ << " worker processes" << std::endl;
+		} else {
+			std::cout << "Worker processes unavailable, processing in one process"
+					  << std::endl;
+		}
+	}
+	
+	//Cached frames only come back here if the workers can't take a pass
+	if ( coordinator.workercount_ > 0 ) stagecachebytes = 0;
+	StageCache stagecache{ stagecachebytes > 0 ? framecache.cachedframes_ : 0u,
+						   stagecachebytes };
 
-	//Create variable classes
+	//Create variable classes, starting from the default constants.  Settings the
+	//learner doesn't sweep come from the command line.
+	LaneDetectConstants defaultconstants;
+	defaultconstants.k_useroi = useroi;
+	defaultconstants.k_downscale = downscale;
+	if ( roimargin >= 0 ) defaultconstants.k_roimargin = roimargin;
 	double increment{0.5};
 	std::vector<LaneConstant> laneconstants;
 	//Sort by sequence in code!
 	//laneconstants.push_back( LaneConstant( "k_lengthwidthratio",
-	//	lanedetectconstants::k_lengthwidthratio, 0.0, 15.0, 0.05*increment) );
+	//	defaultconstants.k_lengthwidthratio, 0.0, 15.0, 0.05*increment) );
 	//laneconstants.push_back( LaneConstant( "k_vanishingpointy",
-	//	lanedetectconstants::k_vanishingpointy, 180.0, 280, 0.05*increment) );
+	//	defaultconstants.k_vanishingpointy, 180.0, 280, 0.05*increment) );
 	laneconstants.push_back( LaneConstant( "k_maxvanishingpointangle",
-		lanedetectconstants::k_maxvanishingpointangle, 5.0, 40.0, -0.05*increment) );
+		defaultconstants.k_maxvanishingpointangle, 5.0, 40.0, -0.05*increment) );
 	laneconstants.push_back( LaneConstant( "k_weightedangleoffset",
-		lanedetectconstants::k_weightedangleoffset, -10.0, -1.0, -0.05*increment) );
+		defaultconstants.k_weightedangleoffset, -10.0, -1.0, -0.05*increment) );
 	laneconstants.push_back( LaneConstant( "k_weightedcenteroffset",
-		lanedetectconstants::k_weightedcenteroffset,-10.0, -1.0, -0.05*increment) );
+		defaultconstants.k_weightedcenteroffset,-10.0, -1.0, -0.05*increment) );
 	laneconstants.push_back( LaneConstant( "k_weightedheightwidth",
-		lanedetectconstants::k_weightedheightwidth, 100.0, 400.0, 0.05*increment) );
+		defaultconstants.k_weightedheightwidth, 100.0, 400.0, 0.05*increment) );
 	laneconstants.push_back( LaneConstant( "k_lowestscorelimit",
-		lanedetectconstants::k_lowestscorelimit, -500.0, 500.0, 0.05*increment) );
+		defaultconstants.k_lowestscorelimit, -500.0, 500.0, 0.05*increment) );
 	laneconstants.push_back( LaneConstant( "k_minimumpolygonheight",
-		lanedetectconstants::k_minimumpolygonheight, 5, 100, 0.05*increment) );
+		defaultconstants.k_minimumpolygonheight, 5, 100, 0.05*increment) );
 	//laneconstants.push_back( LaneConstant( "k_segmentminimumsize",
-	//	lanedetectconstants::k_segmentminimumsize, 5.0, 40.0, 0.05*increment) );
+	//	defaultconstants.k_segmentminimumsize, 5.0, 40.0, 0.05*increment) );
 	//laneconstants.push_back( LaneConstant( "k_segmentlengthwidthratio",
-	//	lanedetectconstants::k_segmentlengthwidthratio, 1.0, 5.0, 0.05*increment) );
+	//	defaultconstants.k_segmentlengthwidthratio, 1.0, 5.0, 0.05*increment) );
 	//laneconstants.push_back( LaneConstant( "k_segmentsanglewindow",
-	//	lanedetectconstants::k_segmentsanglewindow, 5.0, 45.0, 0.05*increment) );
+	//	defaultconstants.k_segmentsanglewindow, 5.0, 45.0, 0.05*increment) );
 	laneconstants.push_back( LaneConstant( "k_minimumsize",
-		lanedetectconstants::k_minimumsize, 10.0, 80.0, 0.05*increment) );
+		defaultconstants.k_minimumsize, 10.0, 80.0, 0.05*increment) );
 	laneconstants.push_back( LaneConstant( "k_minimumangle",
-		lanedetectconstants::k_minimumangle, 20.0, 45.0, 0.05*increment) );
+		defaultconstants.k_minimumangle, 20.0, 45.0, 0.05*increment) );
 	laneconstants.push_back( LaneConstant( "k_anglefromcenter",
-		lanedetectconstants::k_anglefromcenter, 5.0, 45.0, 0.05*increment) );
+		defaultconstants.k_anglefromcenter, 5.0, 45.0, 0.05*increment) );
 	laneconstants.push_back( LaneConstant( "k_contrastscalefactor",
-		lanedetectconstants::k_contrastscalefactor, 0.2, 0.4, 0.05*increment) );
+		defaultconstants.k_contrastscalefactor, 0.2, 0.4, 0.05*increment) );
 	std::cout << laneconstants.size() << " variables to modify" << std::endl;
 	
 	//Create header of resultsfile file
@@ -127,89 +384,206 @@ int main(int argc,char *argv[])
 	}
 	resultsfile << "average match" << ",";
 	resultsfile << "frames detected" << "," << "total frames" << "," << "percent detected";
-	resultsfile << "," << "score" << "," << "runtime" << "," << "fps" << "," << std::endl;
+	resultsfile << "," << "score" << "," << "runtime" << "," << "fps" << "," << "rung" << ",";
+	resultsfile << std::endl;
 
 	
-	//Create resultsfile vector
-	ResultValues resultvalues{totalframes};
-	int iterationcount{0};
-	bool first{true};
-	
-	//Iterate through each variable
-	for ( int i = 0; i < laneconstants.size(); i++ ) {
-	//for ( int i = laneconstants.size() - 1; i >= 0; i-- ) {
-		if ( !first ) laneconstants[i].Modify();
-		first = false;
-		resultvalues.NewVariable();
-		for(;;) {
-			resultvalues.NewIteration();
-			UpdateLaneConstants(laneconstants);
-			std::chrono::high_resolution_clock::time_point starttime;
-			starttime =  std::chrono::high_resolution_clock::now();
-			iterationcount++;
-			uint32_t frameschecked{0};
-			resultsfile << iterationcount << "," << std::fixed << std::setprecision(4);
-			for( int j = 0; j < laneconstants.size(); j++ ) {
-				resultsfile << laneconstants[j].value_ << ",";
-			}
-			
-			//iterate through each file	
-			for (int j = 1; j < argc; j++ ) {
-				cv::VideoCapture capture(argv[j]);
-				std::mutex framesmutex;
-				std::queue<cv::Mat> frames;
-				std::atomic<bool> done{false};
-				//Multi-threading saves ~20% runtime
-				std::thread t_imagequeue( FrameLoaderThread, &capture, &framesmutex, &frames, &done);
-				t_imagequeue.detach();
-				int framecount{0};
-				while ( !(done && frames.empty()) ) {
-					framesmutex.lock();
-					if ( frames.empty() ) {
-						framesmutex.unlock();
-						continue;
-					}
-					framecount++;
-					cv::Mat frame{frames.front()};
-					frames.pop();
-					framesmutex.unlock();
-					Polygon polygon;
-					ProcessImage( frame, polygon );
-					resultvalues.Push( polygon );
-					frameschecked++;
-					if (frameschecked%messagecount == 0) {
-						std::cout << "Iteration " << iterationcount << ", file "
-								  << j << ", ";
-						std::cout << std::fixed << std::setprecision(0);
-						std::cout << ((100.0*framecount)/capture.get(cv::CAP_PROP_FRAME_COUNT));
-						std::cout << "% file, " << ((100.0*frameschecked)/totalframes);
-						std::cout << "% iteration, variable: ";
-						std::cout << laneconstants[i].variablename_ << std::endl;
+	//Frames within a pass are independent, spread them over every core
+	ThreadPool threadpool{ threadcount };
+	std::cout << threadpool.threadcount_ << " processing threads" << std::endl;
+	ResultValues emptyresults{ totalframes, validatematch, framesize };
+	emptyresults.logframes_ = !framelogfilename.empty();
+	
+	//Ground truth of videos with a label file beside them, the rest keep the default
+	//target
+	LabelStore labelstore{ filestart, emptyresults.optimalpolygon_ };
+	for ( int i = 0; i < filenames.size(); i++ ) {
+		std::string labelfilename{ filenames[i] + ".labels" };
+		if ( !std::ifstream(labelfilename).is_open() ) continue;
+		uint32_t fileframes{ ((i + 1) < filenames.size()) ? filestarts[i + 1] - filestarts[i] :
+															filestart - filestarts[i] };
+		if ( labelstore.Load(labelfilename, filestarts[i], fileframes) ) {
+			std::cout << "Labels " << labelfilename << std::endl;
+		} else {
+			std::cout << "Labels " << labelfilename << " unreadable, using the default "
+					  << "target" << std::endl;
+		}
+	}
+	if ( labelstore.labelledfiles_ > 0 ) {
+		std::cout << labelstore.keyframes_ << " keyframes labelled in "
+				  << labelstore.labelledfiles_ << " files" << std::endl;
+		emptyresults.labels_ = &labelstore;
+	}
+	
+	//Score the lane tracker with the default constants instead of learning
+	if ( track ) {
+		ResultValues trackresults{ emptyresults };
+		ReplayTracker( filenames, rawformat, filestarts, defaultconstants, trackresults );
+		return 1;
+	}
+	if ( batchsize == 0 ) batchsize = std::max( 2 * threadpool.threadcount_, 8 );
+	
+	//Results depend on these settings, a checkpoint is only resumed under the same ones.
+	//Pass count is left out so a finished optimizer run can be resumed for longer.
+	std::ostringstream runsettings;
+	runsettings << std::setprecision(17);
+	for ( const std::string& filename : filenames ) {
+		runsettings << filename << ";";
+	}
+	runsettings << totalframes << ";" << rawformat.framesize.width << "x"
+				<< rawformat.framesize.height << ";" << static_cast<int>(rawformat.format)
+				<< ";" << downscale << ";" << useroi << ";" << roimargin << ";" << halving
+				<< ";" << usebatch << ";" << optimizername << ";" << seed << ";"
+				<< batchsize << ";" << labelstore.hash_ << ";";
+	for ( const LaneConstant& laneconstant : laneconstants ) {
+		runsettings << laneconstant.variablename_ << "," << laneconstant.minvalue_ << ","
+					<< laneconstant.maxvalue_ << "," << laneconstant.value_ << ";";
+	}
+	uint64_t runhash{ ResultCache::Hash(runsettings.str()) };
+	ResultCache resultcache{ checkpointfilename, runhash };
+	if ( resume ) {
+		if ( resultcache.Load() ) {
+			std::cout << "Resuming from " << checkpointfilename << ", "
+					  << resultcache.recordcount_ << " results cached up to iteration "
+					  << resultcache.iterationcount_ << std::endl;
+		} else {
+			std::cout << "No checkpoint for these settings in " << checkpointfilename
+					  << ", starting from the beginning" << std::endl;
+		}
+	}
+	
+	//Per frame results of every evaluated candidate, for rescoring offline.  The first
+	//index of each file is recorded so files can be weighted.
+	std::unique_ptr<FrameLogWriter> framelog;
+	if ( !framelogfilename.empty() ) {
+		FrameLogHeader logheader;
+		std::memset( &logheader, 0, sizeof(logheader) );
+		logheader.valuecount = laneconstants.size();
+		logheader.totalframes = totalframes;
+		logheader.framewidth = framesize.width;
+		logheader.frameheight = framesize.height;
+		for ( int i = 0; i < 4; i++ ) {
+			logheader.optimalpolygon[2 * i] = emptyresults.optimalpolygon_[i].x;
+			logheader.optimalpolygon[2 * i + 1] = emptyresults.optimalpolygon_[i].y;
+		}
+		logheader.runhash = runhash;
+		logheader.labelhash = (labelstore.labelledfiles_ > 0) ? labelstore.hash_ : 0;
+		framelog.reset( new FrameLogWriter(framelogfilename, logheader, filestarts, resume) );
+		if ( framelog->failed_ ) {
+			std::cout << "Frame log failed to open, continuing without" << std::endl;
+			framelog.reset();
+		}
+	}
+	const EvaluationSetup setup{ filenames,
+								 filestarts,
+								 rawformat,
+								 framecache,
+								 stagecache,
+								 totalframes,
+								 halving,
+								 emptyresults,
+								 threadpool,
+								 resultcache,
+								 &coordinator,
+								 framelog.get() };
+	double maxmatcherror{0.0};
+	
+	//Search every variable at once when an optimizer is chosen
+	if ( !optimizername.empty() ) {
+		std::vector<SearchDimension> dimensions;
+		for ( const LaneConstant& laneconstant : laneconstants ) {
+			dimensions.push_back( SearchDimension{ laneconstant.variablename_,
+												   laneconstant.minvalue_,
+												   laneconstant.maxvalue_,
+												   laneconstant.value_,
+												   IsIntegerLaneDetectConstant(
+													   laneconstant.variablename_) } );
+		}
+		std::unique_ptr<Optimizer> optimizer{ CreateOptimizer(optimizername,
+															  dimensions,
+															  seed) };
+		if ( !optimizer ) {
+			std::cout << "Unknown optimizer, expected random, cmaes or tpe" << std::endl;
+			return 0;
+		}
+		RunOptimizer( setup,
+					  *optimizer,
+					  passes,
+					  batchsize,
+					  defaultconstants,
+					  resultsfile,
+					  maxmatcherror );
+	} else {
+		//Create resultsfile vector
+		ResultValues resultvalues{ emptyresults };
+		int iterationcount{0};
+		bool first{true};
+		
+		//Iterate through each variable
+		for ( int i = 0; i < laneconstants.size(); i++ ) {
+		//for ( int i = laneconstants.size() - 1; i >= 0; i-- ) {
+			if ( !first ) laneconstants[i].Modify();
+			first = false;
+			resultvalues.NewVariable();
+			for(;;) {
+				//Collect this pass's candidates.  Stepping doesn't depend on the score,
+				//so in batch mode every remaining step of the variable is known up front
+				//by replaying Update on copies.
+				std::vector<LaneDetectConstants> candidates;
+				std::vector< std::vector<double> > candidatevalues;
+				std::vector<LaneConstant> simulatedconstants{ laneconstants };
+				ResultValues simulatedresults{ resultvalues };
+				for(;;) {
+					LaneDetectConstants constants{ defaultconstants };
+					UpdateLaneConstants(simulatedconstants, constants);
+					candidates.push_back( constants );
+					candidatevalues.push_back( std::vector<double>() );
+					for( int j = 0; j < simulatedconstants.size(); j++ ) {
+						candidatevalues.back().push_back( simulatedconstants[j].value_ );
 					}
+					if ( !usebatch ) break;
+					simulatedresults.Update(simulatedconstants[i]);
+					if (simulatedconstants[i].finished_) break;
+				}
+				
+				std::vector<ResultRecord> records;
+				EvaluateBatch( setup,
+							   candidates,
+							   candidatevalues,
+							   laneconstants[i].variablename_,
+							   iterationcount + 1,
+							   records );
+				
+				//Update in candidate order exactly as a sequential sweep would.  It only
+				//steps the variable, each row comes from the candidate's record.
+				for ( int k = 0; k < candidates.size(); k++ ) {
+					iterationcount++;
+					resultvalues.NewIteration();
+					resultvalues.Update(laneconstants[i]);
+					WriteResultRow( resultsfile, iterationcount, candidatevalues[k], records[k] );
+					maxmatcherror = std::max( maxmatcherror, records[k].maxmatcherror );
 				}
-				capture.release();
+				SaveCheckpoint( resultcache, iterationcount );
+				if (laneconstants[i].finished_) break;
 			}
-			
-			//Update
-			resultvalues.Update(laneconstants[i]);
-			double runtime{std::chrono::duration_cast<std::chrono::microseconds>
-				(std::chrono::high_resolution_clock::now() - starttime).count()/1000000.0};
-			double fps{totalframes/runtime};
-			resultsfile << resultvalues.averagematch_ << ",";
-			resultsfile << resultvalues.detectedframes_ << "," << totalframes << ",";
-			resultsfile << std::fixed << std::setprecision(2);
-			resultsfile << ((resultvalues.detectedframes_ * 100.0) / totalframes) << ",";
-			resultsfile << resultvalues.outputscore_ << ",";
-			resultsfile << std::fixed << std::setprecision(3) << runtime << ",";
-			resultsfile << fps << "," << std::endl;
-			if (laneconstants[i].finished_) break;
 		}
+		resultsfile << "Final" << ",";
+		for( int i = 0; i < laneconstants.size(); i++ ) {
+			resultsfile << laneconstants[i].value_ << ",";
+		}
+		resultsfile << std::endl;
 	}
-	resultsfile << "Final" << ",";
-	for( int i = 0; i < laneconstants.size(); i++ ) {
-		resultsfile << laneconstants[i].value_ << ",";
+	if ( stagecache.releasedframes_ > 0 ) {
+		std::cout << stagecache.releasedframes_ << " frames left out of the stage cache to "
+				  << "stay within " << cachebudgetmb << " MB" << std::endl;
+	}
+	if ( validatematch ) {
+		std::cout << "Largest analytic vs raster match difference " <<
+			maxmatcherror << " points" << std::endl;
+		if ( maxmatcherror > k_matchtolerance ) {
+			std::cout << "Warning, exceeds tolerance of " << k_matchtolerance << std::endl;
+		}
 	}
-	resultsfile << std::endl;
 	
 	//Close up shop
 	resultsfile.close();
@@ -217,45 +591,451 @@ int main(int argc,char *argv[])
 }
 
 /*****************************************************************************************/
-void UpdateLaneConstants(std::vector<LaneConstant> &laneconstants)
+void EvaluateBatch( const EvaluationSetup& setup,
+					const std::vector<LaneDetectConstants>& candidates,
+					const std::vector< std::vector<double> >& candidatevalues,
+					const std::string& variablename,
+					const uint64_t firstiteration,
+					std::vector<ResultRecord>& records )
 {
+	//Candidates already in the result cache aren't evaluated again
+	records.assign( candidates.size(), ResultRecord() );
+	std::vector<int> uncached;
+	std::vector<LaneDetectConstants> uncachedcandidates;
+	for ( int k = 0; k < candidates.size(); k++ ) {
+		if ( !setup.resultcache.Find(candidatevalues[k], firstiteration + k, records[k]) ) {
+			uncached.push_back( k );
+			uncachedcandidates.push_back( candidates[k] );
+		}
+	}
+	if ( uncached.empty() ) return;
 	
-	for ( LaneConstant &l : laneconstants) {
-		if (l.variablename_ == "k_weightedheightwidth" ) {
-			lanedetectconstants::k_weightedheightwidth = l.value_;
-		} else if (l.variablename_ == "k_contrastscalefactor" ) {
-			lanedetectconstants::k_contrastscalefactor = l.value_;
-		} else if (l.variablename_ == "k_anglefromcenter" ) {
-			lanedetectconstants::k_anglefromcenter = l.value_;
-		} else if (l.variablename_ == "k_maxvanishingpointangle" ) {
-			lanedetectconstants::k_maxvanishingpointangle = l.value_;
-		//} else if (l.variablename_ == "k_segmentlengthwidthratio" ) {
-		//	lanedetectconstants::k_segmentlengthwidthratio = l.value_;
-		} else if (l.variablename_ == "k_minimumsize" ) {
-			lanedetectconstants::k_minimumsize = l.value_;
-		} else if (l.variablename_ == "k_minimumangle" ) {
-			lanedetectconstants::k_minimumangle = l.value_;
-		} else if (l.variablename_ == "k_lengthwidthratio" ) {
-			lanedetectconstants::k_lengthwidthratio = l.value_;
-		} else if (l.variablename_ == "k_minroadwidth" ) {
-			lanedetectconstants::k_minroadwidth = l.value_;
-		} else if (l.variablename_ == "k_maxroadwidth" ) {
-			lanedetectconstants::k_maxroadwidth = l.value_;
-		} else if (l.variablename_ == "k_segmentsanglewindow" ) {
-			lanedetectconstants::k_segmentsanglewindow = l.value_;
-		} else if (l.variablename_ == "k_minimumpolygonheight" ) {
-			lanedetectconstants::k_minimumpolygonheight = l.value_;
-		} else if (l.variablename_ == "k_segmentminimumsize" ) {
-			lanedetectconstants::k_segmentminimumsize = l.value_;
-		} else if (l.variablename_ == "k_weightedcenteroffset" ) {
-			lanedetectconstants::k_weightedcenteroffset = l.value_;
-		} else if (l.variablename_ == "k_weightedangleoffset" ) {
-			lanedetectconstants::k_weightedangleoffset = l.value_;
-		} else if (l.variablename_ == "k_vanishingpointy" ) {
-			lanedetectconstants::k_vanishingpointy = l.value_;
-		} else if (l.variablename_ == "k_lowestscorelimit" ) {
-			lanedetectconstants::k_lowestscorelimit = l.value_;
-		} else {
+	std::chrono::high_resolution_clock::time_point starttime;
+	starttime =  std::chrono::high_resolution_clock::now();
+	std::vector<ResultValues> candidateresults;
+	std::vector<int> candidaterungs;
+	int rungcount{ EvaluatePass(setup,
+								uncachedcandidates,
+								variablename,
+								candidateresults,
+								candidaterungs) };
+	double runtime{std::chrono::duration_cast<std::chrono::microseconds>
+		(std::chrono::high_resolution_clock::now() - starttime).count()/1000000.0};
+	runtime /= uncached.size();
+	
+	//Candidates dropped early are reported over the frames they saw
+	for ( int u = 0; u < uncached.size(); u++ ) {
+		ResultValues& results{ candidateresults[u] };
+		ResultRecord& record{ records[uncached[u]] };
+		bool complete{ candidaterungs[u] == (rungcount - 1) };
+		record.frames = complete ? setup.totalframes : results.evaluatedframes_;
+		record.detectedframes = results.detectedframes_;
+		record.averagematch = results.AverageMatch();
+		record.score = results.ScoreOver( record.frames );
+		record.runtime = runtime;
+		record.fps = setup.totalframes / runtime;
+		record.maxmatcherror = results.maxmatcherror_;
+		record.rung = candidaterungs[u];
+		record.complete = complete ? 1 : 0;
+		record.iteration = firstiteration + uncached[u];
+		setup.resultcache.Insert( candidatevalues[uncached[u]], record );
+		if ( (setup.framelog != nullptr) &&
+			 !setup.framelog->Append(firstiteration + uncached[u],
+									 candidatevalues[uncached[u]],
+									 record.frames,
+									 record.rung,
+									 results.frameresults_) ) {
+			std::cout << "Frame log failed to write, continuing without" << std::endl;
+		}
+	}
+	
+	return;
+}
+
+/*****************************************************************************************/
+int EvaluatePass( const EvaluationSetup& setup,
+				  const std::vector<LaneDetectConstants>& candidates,
+				  const std::string& variablename,
+				  std::vector<ResultValues>& candidateresults,
+				  std::vector<int>& candidaterungs )
+{
+	//Successive halving ranks the candidates on a growing subset of frames at each
+	//rung, keeping the best 1/halving.  Only the last rung sees every frame, and
+	//without halving it is the only one.
+	const int halving{ setup.halving };
+	int rungcount{1};
+	if ( halving > 1 ) {
+		uint32_t stride{1};
+		for ( size_t remaining = candidates.size(); remaining > 1;
+			  remaining = (remaining + halving - 1) / halving ) {
+			if ( (setup.totalframes / (stride * halving)) < k_minimumrungframes ) break;
+			stride *= halving;
+			rungcount++;
+		}
+	}
+	
+	//Each rung adds its frames to the results of the candidates still running
+	candidateresults.assign( candidates.size(), setup.emptyresults );
+	candidaterungs.assign( candidates.size(), 0 );
+	std::vector<int> active( candidates.size() );
+	std::iota( active.begin(), active.end(), 0 );
+	uint32_t previousstride{0};
+	for ( int rung = 0; rung < rungcount; rung++ ) {
+		uint32_t stride{1};
+		for ( int r = rung + 1; r < rungcount; r++ ) {
+			stride *= halving;
+		}
+		std::vector<LaneDetectConstants> rungcandidates;
+		for ( int k : active ) {
+			rungcandidates.push_back( candidates[k] );
+			candidaterungs[k] = rung;
+		}
+		std::vector<ResultValues> rungresults( rungcandidates.size(), setup.emptyresults );
+		EvaluateCandidates( setup.filenames,
+							setup.filestarts,
+							setup.rawformat,
+							setup.framecache,
+							setup.stagecache,
+							rungcandidates,
+							setup.totalframes,
+							FrameSubset{ stride, previousstride },
+							variablename,
+							setup.threadpool,
+							setup.coordinator,
+							rungresults );
+		for ( int a = 0; a < active.size(); a++ ) {
+			candidateresults[active[a]].Merge( rungresults[a] );
+		}
+		previousstride = stride;
+		if ( rung == (rungcount - 1) ) break;
+		
+		//Keep the best, ties to the earlier candidate
+		std::vector<double> scores( candidates.size(), 0.0 );
+		for ( int k : active ) {
+			scores[k] = candidateresults[k].PartialScore();
+		}
+		std::stable_sort( active.begin(), active.end(), [&scores]( int a, int b )
+						  { return scores[a] > scores[b]; } );
+		active.resize( (active.size() + halving - 1) / halving );
+		std::sort( active.begin(), active.end() );
+	}
+	
+	return rungcount;
+}
+
+/*****************************************************************************************/
+void RunOptimizer( const EvaluationSetup& setup,
+				   Optimizer& optimizer,
+				   const int passes,
+				   const int batchsize,
+				   const LaneDetectConstants& defaultconstants,
+				   std::ofstream& resultsfile,
+				   double& maxmatcherror )
+{
+	int iterationcount{0};
+	for ( int pass = 0; pass < passes; pass++ ) {
+		std::vector< std::vector<double> > candidatevalues;
+		optimizer.Propose( batchsize, candidatevalues );
+		std::vector<LaneDetectConstants> candidates;
+		for ( const std::vector<double>& values : candidatevalues ) {
+			LaneDetectConstants constants{ defaultconstants };
+			for ( int j = 0; j < values.size(); j++ ) {
+				SetLaneDetectConstant( constants, optimizer.dimensions_[j].variablename,
+									   values[j] );
+			}
+			candidates.push_back( constants );
+		}
+		
+		//Whole batch in one pass over the frames.  Candidates dropped by successive
+		//halving are scored over the frames they saw and still inform the optimizer,
+		//but never end up as the final values.
+		std::vector<ResultRecord> records;
+		EvaluateBatch( setup,
+					   candidates,
+					   candidatevalues,
+					   "pass " + std::to_string(pass + 1) + " of " + std::to_string(passes),
+					   iterationcount + 1,
+					   records );
+		std::vector<double> scores;
+		std::vector<bool> complete;
+		for ( int k = 0; k < candidates.size(); k++ ) {
+			scores.push_back( records[k].score );
+			complete.push_back( records[k].complete != 0 );
+			maxmatcherror = std::max( maxmatcherror, records[k].maxmatcherror );
+			iterationcount++;
+			WriteResultRow( resultsfile, iterationcount, candidatevalues[k], records[k] );
+		}
+		optimizer.Report( candidatevalues, scores, complete );
+		SaveCheckpoint( setup.resultcache, iterationcount );
+		std::cout << "Pass " << (pass + 1) << " of " << passes << ", best score "
+				  << optimizer.bestscore_ << std::endl;
+	}
+	resultsfile << "Final" << ",";
+	for ( double value : optimizer.bestvalues_ ) {
+		resultsfile << value << ",";
+	}
+	resultsfile << std::endl;
+	
+	return;
+}
+
+/*****************************************************************************************/
+void WriteResultRow( std::ofstream& resultsfile,
+					 const int iteration,
+					 const std::vector<double>& values,
+					 const ResultRecord& record )
+{
+	resultsfile << iteration << "," << std::fixed << std::setprecision(4);
+	for( int j = 0; j < values.size(); j++ ) {
+		resultsfile << values[j] << ",";
+	}
+	resultsfile << record.averagematch << ",";
+	resultsfile << record.detectedframes << "," << record.frames << ",";
+	resultsfile << std::fixed << std::setprecision(2);
+	resultsfile << ((record.detectedframes * 100.0) / std::max(record.frames, 1u)) << ",";
+	resultsfile << record.score << ",";
+	resultsfile << std::fixed << std::setprecision(3) << record.runtime << ",";
+	resultsfile << record.fps << "," << record.rung << "," << std::endl;
+	
+	return;
+}
+
+/*****************************************************************************************/
+void SaveCheckpoint( ResultCache& resultcache,
+					 const int iterationcount )
+{
+	//Every iteration so far, a killed run resumes from here with --resume
+	if ( !resultcache.Save(iterationcount) ) {
+		std::cout << "Checkpoint failed to save, continuing without" << std::endl;
+	}
+	return;
+}
+
+/*****************************************************************************************/
+void EvaluateCandidates( const std::vector<std::string>& filenames,
+						 const std::vector<uint32_t>& filestarts,
+						 const RawVideoFormat& rawformat,
+						 const FrameCache& framecache,
+						 StageCache& stagecache,
+						 const std::vector<LaneDetectConstants>& candidates,
+						 const uint32_t totalframes,
+						 const FrameSubset& subset,
+						 const std::string& variablename,
+						 ThreadPool& threadpool,
+						 WorkerCoordinator* coordinator,
+						 std::vector<ResultValues>& candidateresults )
+{
+	//Set how often to message console
+	uint32_t subsetframes{ std::max(subset.Count(totalframes), 1u) };
+	uint32_t messagecount{std::max(subsetframes/100, 1u)};	//Every 1%
+	std::atomic<uint32_t> frameschecked{0};
+	std::mutex consolemutex;
+	uint32_t cachedframeindex{0};
+	uint32_t frameindex{0};
+	
+	//Empty accumulator to copy, avoids redrawing the optimal mat for every chunk
+	ResultValues emptyresults{ candidateresults.front() };
+	emptyresults.NewIteration();
+	
+	//Scratch buffers per pool thread
+	std::vector<ProcessingWorkspace> workspaces( threadpool.threadcount_ );
+	
+	//Frames are split into fixed chunks with their own accumulators, merging them in
+	//chunk order gives the same per frame order as a serial run whichever thread ran
+	//each chunk
+	auto processframes = [&]( const std::vector<cv::Mat>& frames,
+							  bool preprocessed,
+							  uint32_t cacheoffset,
+							  int fileindex,
+							  double fileframes,
+							  uint32_t filestart ) {
+		//Only this subset's frames, indices are over all files
+		std::vector<int> selected;
+		for ( int f = 0; f < frames.size(); f++ ) {
+			if ( subset.Contains(frameindex + f) ) selected.push_back( f );
+		}
+		uint32_t firstframe{ frameindex };
+		frameindex += frames.size();
+		int chunkcount{ static_cast<int>((selected.size() + k_framesperchunk - 1) /
+										 k_framesperchunk) };
+		std::vector< std::vector<ResultValues> > chunkresults( chunkcount );
+		threadpool.ParallelFor( chunkcount, [&]( int chunk, int thread ) {
+			std::vector<ResultValues>& partialresults{ chunkresults[chunk] };
+			partialresults.assign( candidates.size(), emptyresults );
+			ProcessingWorkspace& workspace{ workspaces[thread] };
+			std::vector<Polygon>& polygons{ workspace.polygons };
+			int first{ chunk * k_framesperchunk };
+			int last{ std::min(first + k_framesperchunk, static_cast<int>(selected.size())) };
+			for ( int s = first; s < last; s++ ) {
+				int f{ selected[s] };
+				if ( preprocessed ) {
+					ProcessingCache* cache{ stagecache.Frame(cacheoffset + f) };
+					ProcessBlurredImageBatch( frames[f],
+											  candidates,
+											  polygons,
+											  cache,
+											  &workspace );
+					if ( cache != nullptr ) stagecache.Account( cacheoffset + f );
+				} else {
+					PreprocessImage( frames[f],
+									 workspace.blurredimage,
+									 &workspace,
+									 &workspace.cache,
+									 candidates.front().k_downscale );
+					ProcessBlurredImageBatch( workspace.blurredimage,
+											  candidates,
+											  polygons,
+											  &workspace.cache,
+											  &workspace );
+				}
+				for ( int k = 0; k < candidates.size(); k++ ) {
+					partialresults[k].Push( polygons[k], firstframe + f );
+				}
+				uint32_t checked{ ++frameschecked };
+				if (checked%messagecount == 0) {
+					std::lock_guard<std::mutex> lock( consolemutex );
+					std::cout << candidates.size() << " candidates, file "
+							  << (fileindex + 1) << ", ";
+					std::cout << std::fixed << std::setprecision(0);
+					std::cout << ((100.0*(filestart + f + 1))/fileframes);
+					std::cout << "% file, " << ((100.0*checked)/subsetframes);
+					std::cout << "% iteration, variable: ";
+					std::cout << variablename << std::endl;
+				}
+			}
+		} );
+		for ( int chunk = 0; chunk < chunkcount; chunk++ ) {
+			for ( int k = 0; k < candidates.size(); k++ ) {
+				candidateresults[k].Merge( chunkresults[chunk][k] );
+			}
+		}
+	};
+	
+	//Cached frames can go to the worker processes a block at a time.  Only polygons
+	//come back, and they are pushed here in frame order so the results are the same
+	//as an in-process run.
+	int shardblockframes{ (coordinator != nullptr) ?
+						  coordinator->BlockFrames( candidates.size() ) : 0 };
+	auto shardframes = [&]( const std::vector<cv::Mat>& frames,
+							uint32_t cacheoffset,
+							int fileindex ) {
+		std::vector<uint32_t> selected;
+		for ( int f = 0; f < frames.size(); f++ ) {
+			if ( subset.Contains(frameindex + f) ) selected.push_back( cacheoffset + f );
+		}
+		uint32_t firstframe{ frameindex };
+		frameindex += frames.size();
+		for ( size_t first = 0; first < selected.size(); first += shardblockframes ) {
+			int blockcount{ static_cast<int>(std::min(selected.size() - first,
+											static_cast<size_t>(shardblockframes))) };
+			if ( !coordinator->Run(candidates, &selected[first], blockcount) ) {
+				std::cout << "Worker process lost, rerun with --resume to continue"
+						  << std::endl;
+				exit(1);
+			}
+			const Polygon* polygons{ coordinator->Polygons() };
+			int chunkcount{ (blockcount + k_framesperchunk - 1) / k_framesperchunk };
+			std::vector< std::vector<ResultValues> > chunkresults( chunkcount );
+			threadpool.ParallelFor( chunkcount, [&]( int chunk, int thread ) {
+				std::vector<ResultValues>& partialresults{ chunkresults[chunk] };
+				partialresults.assign( candidates.size(), emptyresults );
+				int last{ std::min((chunk + 1) * k_framesperchunk, blockcount) };
+				for ( int s = chunk * k_framesperchunk; s < last; s++ ) {
+					uint32_t frame{ firstframe + selected[first + s] - cacheoffset };
+					for ( int k = 0; k < candidates.size(); k++ ) {
+						partialresults[k].Push( polygons[s * candidates.size() + k], frame );
+					}
+				}
+			} );
+			for ( int chunk = 0; chunk < chunkcount; chunk++ ) {
+				for ( int k = 0; k < candidates.size(); k++ ) {
+					candidateresults[k].Merge( chunkresults[chunk][k] );
+				}
+			}
+			frameschecked += blockcount;
+			std::cout << candidates.size() << " candidates, file " << (fileindex + 1) << ", ";
+			std::cout << std::fixed << std::setprecision(0);
+			std::cout << ((100.0*(selected[first + blockcount - 1] - cacheoffset + 1)) /
+						  frames.size());
+			std::cout << "% file, " << ((100.0*frameschecked)/subsetframes);
+			std::cout << "% iteration, variable: ";
+			std::cout << variablename << std::endl;
+		}
+	};
+	
+	//iterate through each file	
+	for (int j = 0; j < filenames.size(); j++ ) {
+		//Indices follow the up front count, a file that decodes short must not shift
+		//the labels, log rows and subsets of the files after it
+		frameindex = filestarts[j];
+		
+		//Cached files skip decode and blur entirely
+		if ( framecache.IsCached(j) ) {
+			const std::vector<cv::Mat>& cachedframes{ framecache.Frames(j) };
+			if ( shardblockframes > 0 ) {
+				shardframes( cachedframes, cachedframeindex, j );
+			} else {
+				processframes( cachedframes, true, cachedframeindex, j,
+							   cachedframes.size(), 0 );
+			}
+			cachedframeindex += cachedframes.size();
+			continue;
+		}
+		
+		//Streamed files are processed a block at a time as frames arrive.  The pool
+		//holds two blocks so decoding continues while the previous block is processed,
+		//and no more decoded frames than k_queuebytes, large frames shrinking the block.
+		FrameReader reader( filenames[j], rawformat );
+		double fileframes{ static_cast<double>(reader.FrameCount()) };
+		uint32_t filestart{0};
+		size_t blockframes{ static_cast<size_t>(k_framesperchunk * threadpool.threadcount_) };
+		uint64_t framebytes{ std::max( static_cast<uint64_t>(reader.FrameSize().area()) *
+									   CV_ELEM_SIZE(reader.FrameType()), uint64_t{1} ) };
+		size_t poolframes{ std::min( 2 * blockframes,
+									 static_cast<size_t>(std::max(k_queuebytes / framebytes,
+																  uint64_t{2})) ) };
+		blockframes = poolframes / 2;
+		FramePool framepool{ static_cast<int>(poolframes),
+							 reader.FrameSize(),
+							 reader.FrameType() };
+		std::vector<cv::Mat> block;
+		std::vector<int> blockbuffers;
+		block.reserve( blockframes );
+		blockbuffers.reserve( blockframes );
+		auto processblock = [&]() {
+			processframes( block, false, 0, j, fileframes, filestart );
+			filestart += block.size();
+			block.clear();
+			for ( int bufferindex : blockbuffers ) {
+				framepool.Release( bufferindex );
+			}
+			blockbuffers.clear();
+		};
+		FrameQueue frames{ blockframes, k_queuebytes };
+		//Multi-threading saves ~20% runtime
+		std::thread t_imagequeue( FrameLoaderThread, &reader, &framepool, &frames );
+		cv::Mat frame;
+		int bufferindex;
+		while ( frames.Pop(frame, &bufferindex) ) {
+			block.push_back( frame );
+			blockbuffers.push_back( bufferindex );
+			if ( block.size() >= blockframes ) processblock();
+		}
+		processblock();
+		t_imagequeue.join();
+		reader.Release();
+	}
+	
+	return;
+}
+
+/*****************************************************************************************/
+void UpdateLaneConstants( const std::vector<LaneConstant> &laneconstants,
+						  LaneDetectConstants& constants )
+{
+	
+	for ( const LaneConstant &l : laneconstants) {
+		if ( !SetLaneDetectConstant(constants, l.variablename_, l.value_) ) {
 			std::cout << "Programming error, variable does not exist!" << std::endl;
 			std::cin.get();
 			exit(0);
@@ -266,25 +1046,60 @@ void UpdateLaneConstants(std::vector<LaneConstant> &laneconstants)
 }
 
 /*****************************************************************************************/
-void FrameLoaderThread(cv::VideoCapture* videocapture, std::mutex* framesmutex, std::queue<cv::Mat>* frames, std::atomic<bool>* done)
+void ReplayTracker( const std::vector<std::string>& filenames,
+					const RawVideoFormat& rawformat,
+					const std::vector<uint32_t>& filestarts,
+					const LaneDetectConstants& constants,
+					ResultValues& results )
 {
-	for( int i =0; i < videocapture->get(cv::CAP_PROP_FRAME_COUNT) - 1; i++  ){
-		cv::Mat frame;
-		for (;;) {			//Don't let queqed frames get too large or program crashes
-			framesmutex->lock();
-			unsigned long int framesqueqed { frames->size() };
-			framesmutex->unlock();
-			if (framesqueqed < 1000) {
-				break;
-			} else {
-				std::this_thread::sleep_for(std::chrono::microseconds(500000)); //500ms
-			}
+	//Each file through the tracker frame by frame, as it would run live
+	LaneTracker tracker;
+	cv::Mat frame;
+	Polygon polygon;
+	uint32_t frames{0};
+	std::chrono::high_resolution_clock::time_point starttime{
+		std::chrono::high_resolution_clock::now() };
+	for ( int j = 0; j < filenames.size(); j++ ) {
+		FrameReader reader( filenames[j], rawformat );
+		tracker.Reset();
+		for ( int i = 0; i < reader.ReadableFrames(); i++ ) {
+			if ( !reader.Read(frame) ) break;
+			tracker.Process( frame, constants, polygon );
+			results.Push( polygon, filestarts[j] + i );
+			frames++;
 		}
-		*videocapture >> frame;
-		framesmutex->lock();
-		frames->push(frame);
-		framesmutex->unlock();
+		reader.Release();
+		std::cout << "Tracked " << filenames[j] << std::endl;
 	}
-	*done = true;
+	double runtime{ std::chrono::duration_cast<std::chrono::microseconds>
+		(std::chrono::high_resolution_clock::now() - starttime).count() / 1000000.0 };
+	
+	std::cout << std::fixed << std::setprecision(2);
+	std::cout << frames << " frames, " << results.detectedframes_ << " detected, "
+			  << tracker.trackedframes_ << " tracked, " << tracker.fallbackframes_
+			  << " fell back to a full search" << std::endl;
+	std::cout << "Average match " << results.AverageMatch() << ", score "
+			  << results.ScoreOver( frames ) << ", "
+			  << (frames / std::max(runtime, 1e-9)) << " fps" << std::endl;
+	
+	return;
+}
+
+/*****************************************************************************************/
+void FrameLoaderThread( FrameReader* framereader,
+						FramePool* framepool,
+						FrameQueue* frames )
+{
+	//Decode into pooled buffers, blocking while none are free or the queue is full
+	for( int i =0; i < framereader->ReadableFrames(); i++  ){
+		int bufferindex{ framepool->Acquire() };
+		cv::Mat& frame{ framepool->Buffer(bufferindex) };
+		if ( !framereader->Read(frame) ) {
+			framepool->Release(bufferindex);
+			break;
+		}
+		frames->Push(frame, bufferindex);
+	}
+	frames->Close();
 	return;
-}
\ No newline at end of file
+}
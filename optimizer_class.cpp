@@ -0,0 +1,398 @@
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <math.h>
+#include "opencv2/opencv.hpp"
+#include "optimizer_class.h"
+
+namespace {
+	//Starting CMA-ES step size, as a fraction of each range
+	const double k_cmaessigma{ 0.3 };
+	
+	//TPE split fraction, points before modelling starts, samples scored per candidate
+	//and narrowest kernel, as a fraction of each range
+	const double k_tpegamma{ 0.25 };
+	const int k_tpestartup{ 10 };
+	const int k_tpesamples{ 24 };
+	const double k_tpeminbandwidth{ 0.05 };
+	
+	double Clamp( double value )
+	{
+		return std::min( std::max(value, 0.0), 1.0 );
+	}
+	
+	//Indices of scores, best first, ties to the earlier point
+	std::vector<int> RankScores( const std::vector<double>& scores )
+	{
+		std::vector<int> order( scores.size() );
+		std::iota( order.begin(), order.end(), 0 );
+		std::stable_sort( order.begin(), order.end(), [&scores]( int a, int b )
+						  { return scores[a] > scores[b]; } );
+		return order;
+	}
+}
+
+/*****************************************************************************************/
+Optimizer::Optimizer( const std::vector<SearchDimension>& dimensions,
+					  uint64_t seed ):
+					  dimensions_( dimensions ),
+					  bestscore_{0.0},
+					  hasbest_{false},
+					  rng_( seed ),
+					  proposedinitial_{false}
+{
+}
+
+void Optimizer::Propose( int count,
+						 std::vector< std::vector<double> >& candidates )
+{
+	std::vector< std::vector<double> > points;
+	ProposePoints( count, points );
+	candidates.assign( points.size(), std::vector<double>(dimensions_.size()) );
+	for ( int i = 0; i < points.size(); i++ ) {
+		for ( int d = 0; d < dimensions_.size(); d++ ) {
+			const SearchDimension& dimension{ dimensions_[d] };
+			candidates[i][d] = dimension.minvalue +
+							   points[i][d] * (dimension.maxvalue - dimension.minvalue);
+			if ( dimension.integer ) {
+				candidates[i][d] = std::min( std::max(round(candidates[i][d]),
+													  ceil(dimension.minvalue)),
+											 floor(dimension.maxvalue) );
+			}
+		}
+	}
+	return;
+}
+
+void Optimizer::Report( const std::vector< std::vector<double> >& candidates,
+						const std::vector<double>& scores,
+						const std::vector<bool>& complete )
+{
+	std::vector< std::vector<double> > points( candidates.size(),
+											   std::vector<double>(dimensions_.size()) );
+	for ( int i = 0; i < candidates.size(); i++ ) {
+		if ( complete[i] && (!hasbest_ || (scores[i] > bestscore_)) ) {
+			bestscore_ = scores[i];
+			bestvalues_ = candidates[i];
+			hasbest_ = true;
+		}
+		for ( int d = 0; d < dimensions_.size(); d++ ) {
+			const SearchDimension& dimension{ dimensions_[d] };
+			double range{ dimension.maxvalue - dimension.minvalue };
+			points[i][d] = (range > 0.0) ?
+						   Clamp( (candidates[i][d] - dimension.minvalue) / range ) : 0.0;
+		}
+	}
+	Learn( points, scores );
+	return;
+}
+
+std::vector<double> Optimizer::InitialPoint() const
+{
+	std::vector<double> point( dimensions_.size(), 0.0 );
+	for ( int d = 0; d < dimensions_.size(); d++ ) {
+		const SearchDimension& dimension{ dimensions_[d] };
+		double range{ dimension.maxvalue - dimension.minvalue };
+		if ( range > 0.0 ) point[d] = Clamp( (dimension.initialvalue - dimension.minvalue) /
+											 range );
+	}
+	return point;
+}
+
+void Optimizer::RandomPoint( std::vector<double>& point )
+{
+	//First one asked for is the initial values, so they are always scored
+	if ( !proposedinitial_ ) {
+		point = InitialPoint();
+		proposedinitial_ = true;
+		return;
+	}
+	point.resize( dimensions_.size() );
+	for ( double& value : point ) {
+		value = rng_.uniform( 0.0, 1.0 );
+	}
+	return;
+}
+
+/*****************************************************************************************/
+RandomOptimizer::RandomOptimizer( const std::vector<SearchDimension>& dimensions,
+								  uint64_t seed ):
+								  Optimizer( dimensions, seed )
+{
+}
+
+void RandomOptimizer::ProposePoints( int count,
+									 std::vector< std::vector<double> >& points )
+{
+	points.resize( count );
+	for ( std::vector<double>& point : points ) {
+		RandomPoint( point );
+	}
+	return;
+}
+
+void RandomOptimizer::Learn( const std::vector< std::vector<double> >& points,
+							 const std::vector<double>& scores )
+{
+	return;
+}
+
+/*****************************************************************************************/
+CmaEsOptimizer::CmaEsOptimizer( const std::vector<SearchDimension>& dimensions,
+								uint64_t seed ):
+								Optimizer( dimensions, seed ),
+								mean_( InitialPoint() ),
+								sigma_{ k_cmaessigma },
+								covariance_( cv::Mat::eye(dimensions.size(),
+														  dimensions.size(),
+														  CV_64F) ),
+								basis_( cv::Mat::eye(dimensions.size(),
+													 dimensions.size(),
+													 CV_64F) ),
+								scales_( dimensions.size(), 1.0 ),
+								pathcovariance_( dimensions.size(), 0.0 ),
+								pathsigma_( dimensions.size(), 0.0 ),
+								generation_{0}
+{
+}
+
+void CmaEsOptimizer::ProposePoints( int count,
+									std::vector< std::vector<double> >& points )
+{
+	//mean + sigma * B * D * z, z standard normal
+	const int n{ static_cast<int>(mean_.size()) };
+	std::vector<double> scaled( n );
+	points.assign( count, std::vector<double>(n) );
+	for ( std::vector<double>& point : points ) {
+		for ( int j = 0; j < n; j++ ) {
+			scaled[j] = scales_[j] * rng_.gaussian( 1.0 );
+		}
+		for ( int i = 0; i < n; i++ ) {
+			double step{0.0};
+			for ( int j = 0; j < n; j++ ) {
+				step += basis_.at<double>(i, j) * scaled[j];
+			}
+			point[i] = Clamp( mean_[i] + sigma_ * step );
+		}
+	}
+	return;
+}
+
+void CmaEsOptimizer::Learn( const std::vector< std::vector<double> >& points,
+							const std::vector<double>& scores )
+{
+	const int n{ static_cast<int>(mean_.size()) };
+	const int mu{ static_cast<int>(points.size()) / 2 };
+	if ( (n == 0) || (mu < 1) ) return;
+	std::vector<int> order{ RankScores(scores) };
+	
+	//Recombination weights and the learning rates that follow from them
+	std::vector<double> weights( mu );
+	for ( int i = 0; i < mu; i++ ) {
+		weights[i] = log( mu + 0.5 ) - log( i + 1.0 );
+	}
+	double weightsum{ std::accumulate(weights.begin(), weights.end(), 0.0) };
+	double squaresum{0.0};
+	for ( double& weight : weights ) {
+		weight /= weightsum;
+		squaresum += weight * weight;
+	}
+	double mueff{ 1.0 / squaresum };
+	double cc{ (4.0 + mueff / n) / (n + 4.0 + 2.0 * mueff / n) };
+	double cs{ (mueff + 2.0) / (n + mueff + 5.0) };
+	double c1{ 2.0 / ((n + 1.3) * (n + 1.3) + mueff) };
+	double cmu{ std::min(1.0 - c1,
+						 2.0 * (mueff - 2.0 + 1.0 / mueff) / ((n + 2.0) * (n + 2.0) + mueff)) };
+	double damps{ 1.0 + 2.0 * std::max(0.0, sqrt((mueff - 1.0) / (n + 1.0)) - 1.0) + cs };
+	double chin{ sqrt(n) * (1.0 - 1.0 / (4.0 * n) + 1.0 / (21.0 * n * n)) };
+	
+	//New mean from the best half, and the step it took in units of sigma
+	std::vector<double> oldmean{ mean_ };
+	std::vector<double> step( n, 0.0 );
+	for ( int i = 0; i < n; i++ ) {
+		mean_[i] = 0.0;
+		for ( int k = 0; k < mu; k++ ) {
+			mean_[i] += weights[k] * points[order[k]][i];
+		}
+		step[i] = (mean_[i] - oldmean[i]) / sigma_;
+	}
+	
+	//Step size path uses C^-1/2 * step = B * D^-1 * B^T * step
+	std::vector<double> whitened( n, 0.0 );
+	for ( int j = 0; j < n; j++ ) {
+		for ( int i = 0; i < n; i++ ) {
+			whitened[j] += basis_.at<double>(i, j) * step[i];
+		}
+		whitened[j] /= scales_[j];
+	}
+	double pathsigmanorm{0.0};
+	for ( int i = 0; i < n; i++ ) {
+		double value{0.0};
+		for ( int j = 0; j < n; j++ ) {
+			value += basis_.at<double>(i, j) * whitened[j];
+		}
+		pathsigma_[i] = (1.0 - cs) * pathsigma_[i] + sqrt(cs * (2.0 - cs) * mueff) * value;
+		pathsigmanorm += pathsigma_[i] * pathsigma_[i];
+	}
+	pathsigmanorm = sqrt( pathsigmanorm );
+	generation_++;
+	bool hsig{ (pathsigmanorm / sqrt(1.0 - pow(1.0 - cs, 2.0 * generation_)) / chin) <
+			   (1.4 + 2.0 / (n + 1.0)) };
+	for ( int i = 0; i < n; i++ ) {
+		pathcovariance_[i] = (1.0 - cc) * pathcovariance_[i] +
+							 (hsig ? sqrt(cc * (2.0 - cc) * mueff) * step[i] : 0.0);
+	}
+	
+	//Rank one update from the path, rank mu update from the best half
+	for ( int i = 0; i < n; i++ ) {
+		for ( int j = 0; j <= i; j++ ) {
+			double rankmu{0.0};
+			for ( int k = 0; k < mu; k++ ) {
+				const std::vector<double>& point{ points[order[k]] };
+				rankmu += weights[k] * ((point[i] - oldmean[i]) / sigma_) *
+									   ((point[j] - oldmean[j]) / sigma_);
+			}
+			double value{ (1.0 - c1 - cmu) * covariance_.at<double>(i, j) +
+						  c1 * (pathcovariance_[i] * pathcovariance_[j] +
+								(hsig ? 0.0 : cc * (2.0 - cc) * covariance_.at<double>(i, j))) +
+						  cmu * rankmu };
+			covariance_.at<double>(i, j) = value;
+			covariance_.at<double>(j, i) = value;
+		}
+	}
+	
+	//Grow the step while the path is longer than a random walk's, a step beyond the
+	//whole cube is never useful
+	sigma_ = std::min( sigma_ * exp((cs / damps) * (pathsigmanorm / chin - 1.0)), 1.0 );
+	Decompose();
+	return;
+}
+
+void CmaEsOptimizer::Decompose()
+{
+	//C = B * D^2 * B^T, cv::eigen returns eigenvectors as rows
+	cv::Mat eigenvalues;
+	cv::Mat eigenvectors;
+	if ( !cv::eigen(covariance_, eigenvalues, eigenvectors) ) return;
+	basis_ = eigenvectors.t();
+	for ( int i = 0; i < scales_.size(); i++ ) {
+		scales_[i] = sqrt( std::max(eigenvalues.at<double>(i, 0), 1e-20) );
+	}
+	return;
+}
+
+/*****************************************************************************************/
+TpeOptimizer::TpeOptimizer( const std::vector<SearchDimension>& dimensions,
+							uint64_t seed ):
+							Optimizer( dimensions, seed )
+{
+}
+
+void TpeOptimizer::ProposePoints( int count,
+								  std::vector< std::vector<double> >& points )
+{
+	points.resize( count );
+	if ( points_.size() < k_tpestartup ) {
+		for ( std::vector<double>& point : points ) {
+			RandomPoint( point );
+		}
+		return;
+	}
+	
+	//Split past points into the best and the rest
+	std::vector<int> order{ RankScores(scores_) };
+	int goodcount{ std::max(static_cast<int>(ceil(k_tpegamma * order.size())), 1) };
+	std::vector<int> good( order.begin(), order.begin() + goodcount );
+	std::vector<int> bad( order.begin() + goodcount, order.end() );
+	std::vector<double> goodbandwidths;
+	std::vector<double> badbandwidths;
+	Bandwidths( good, goodbandwidths );
+	Bandwidths( bad, badbandwidths );
+	
+	//Draws differ candidate to candidate, which keeps a batch spread out
+	const int n{ static_cast<int>(dimensions_.size()) };
+	std::vector<double> sample( n );
+	for ( std::vector<double>& point : points ) {
+		double bestratio{ -std::numeric_limits<double>::infinity() };
+		for ( int s = 0; s < k_tpesamples; s++ ) {
+			const std::vector<double>& centre{ points_[good[rng_.uniform(0, goodcount)]] };
+			for ( int d = 0; d < n; d++ ) {
+				sample[d] = Clamp( centre[d] + goodbandwidths[d] * rng_.gaussian(1.0) );
+			}
+			double ratio{ LogDensity(sample, good, goodbandwidths) -
+						  LogDensity(sample, bad, badbandwidths) };
+			if ( ratio > bestratio ) {
+				bestratio = ratio;
+				point = sample;
+			}
+		}
+	}
+	return;
+}
+
+void TpeOptimizer::Learn( const std::vector< std::vector<double> >& points,
+						  const std::vector<double>& scores )
+{
+	points_.insert( points_.end(), points.begin(), points.end() );
+	scores_.insert( scores_.end(), scores.begin(), scores.end() );
+	return;
+}
+
+double TpeOptimizer::LogDensity( const std::vector<double>& point,
+								 const std::vector<int>& members,
+								 const std::vector<double>& bandwidths ) const
+{
+	//Each dimension is a mixture of a Gaussian per member and a uniform prior, which
+	//keeps the density of an empty or distant set above zero
+	double logdensity{0.0};
+	for ( int d = 0; d < point.size(); d++ ) {
+		double density{1.0};
+		for ( int member : members ) {
+			double z{ (point[d] - points_[member][d]) / bandwidths[d] };
+			density += exp( -0.5 * z * z ) / (bandwidths[d] * sqrt(2.0 * M_PI));
+		}
+		logdensity += log( density / (members.size() + 1.0) );
+	}
+	return logdensity;
+}
+
+void TpeOptimizer::Bandwidths( const std::vector<int>& members,
+							   std::vector<double>& bandwidths ) const
+{
+	//Scott's rule per dimension, never narrower than k_tpeminbandwidth
+	bandwidths.assign( dimensions_.size(), k_tpeminbandwidth );
+	if ( members.size() < 2 ) return;
+	for ( int d = 0; d < dimensions_.size(); d++ ) {
+		double mean{0.0};
+		for ( int member : members ) {
+			mean += points_[member][d];
+		}
+		mean /= members.size();
+		double variance{0.0};
+		for ( int member : members ) {
+			variance += (points_[member][d] - mean) * (points_[member][d] - mean);
+		}
+		variance /= (members.size() - 1);
+		bandwidths[d] = std::max( sqrt(variance) * pow(members.size(), -0.2),
+								  k_tpeminbandwidth );
+	}
+	return;
+}
+
+/*****************************************************************************************/
+std::unique_ptr<Optimizer> CreateOptimizer( const std::string& name,
+											const std::vector<SearchDimension>& dimensions,
+											uint64_t seed )
+{
+	if ( name == "random" ) {
+		return std::unique_ptr<Optimizer>( new RandomOptimizer(dimensions, seed) );
+	} else if ( name == "cmaes" ) {
+		return std::unique_ptr<Optimizer>( new CmaEsOptimizer(dimensions, seed) );
+	} else if ( name == "tpe" ) {
+		return std::unique_ptr<Optimizer>( new TpeOptimizer(dimensions, seed) );
+	}
+	return std::unique_ptr<Optimizer>();
+}
@@ -0,0 +1,122 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include "opencv2/opencv.hpp"
+
+//One searched constant and the range it may take.  Integer dimensions are proposed
+//rounded, so the values evaluated, cached and reported are the ones actually used.
+struct SearchDimension {
+	std::string variablename;
+	double minvalue;
+	double maxvalue;
+	double initialvalue;
+	bool integer;
+};
+
+//Searches every dimension at once.  Each round proposes a batch of candidates, which
+//are all evaluated in one pass over the frames, and is then told their scores, higher
+//being better.  Implementations work on the unit cube, values are mapped to and from
+//each dimension's range here.  Scores of candidates that only saw part of the frames
+//still guide the search, but only complete ones may become the best.
+class Optimizer
+{
+	public:
+		Optimizer( const std::vector<SearchDimension>& dimensions,
+				   uint64_t seed );
+		virtual ~Optimizer() {}
+		void Propose( int count,
+					  std::vector< std::vector<double> >& candidates );
+		void Report( const std::vector< std::vector<double> >& candidates,
+					 const std::vector<double>& scores,
+					 const std::vector<bool>& complete );
+		std::vector<SearchDimension> dimensions_;
+		std::vector<double> bestvalues_;
+		double bestscore_;
+		bool hasbest_;
+
+	protected:
+		virtual void ProposePoints( int count,
+									std::vector< std::vector<double> >& points ) = 0;
+		virtual void Learn( const std::vector< std::vector<double> >& points,
+							const std::vector<double>& scores ) = 0;
+		std::vector<double> InitialPoint() const;
+		void RandomPoint( std::vector<double>& point );
+		cv::RNG rng_;
+		bool proposedinitial_;
+};
+
+//Uniform samples, the first batch also holds the initial values
+class RandomOptimizer : public Optimizer
+{
+	public:
+		RandomOptimizer( const std::vector<SearchDimension>& dimensions,
+						 uint64_t seed );
+
+	protected:
+		void ProposePoints( int count,
+							std::vector< std::vector<double> >& points ) override;
+		void Learn( const std::vector< std::vector<double> >& points,
+					const std::vector<double>& scores ) override;
+};
+
+//Covariance matrix adaptation evolution strategy, one generation per batch.  Starts
+//at the initial values, samples falling outside the cube are clamped onto it.
+class CmaEsOptimizer : public Optimizer
+{
+	public:
+		CmaEsOptimizer( const std::vector<SearchDimension>& dimensions,
+						uint64_t seed );
+
+	protected:
+		void ProposePoints( int count,
+							std::vector< std::vector<double> >& points ) override;
+		void Learn( const std::vector< std::vector<double> >& points,
+					const std::vector<double>& scores ) override;
+
+	private:
+		void Decompose();
+		std::vector<double> mean_;
+		double sigma_;
+		cv::Mat covariance_;
+		cv::Mat basis_;
+		std::vector<double> scales_;
+		std::vector<double> pathcovariance_;
+		std::vector<double> pathsigma_;
+		int generation_;
+};
+
+//Tree structured Parzen estimator.  Past points are split into the best k_tpegamma
+//and the rest, and of several samples drawn around the best ones each candidate is
+//the one most likely under the best relative to the rest.  Random until there are
+//k_tpestartup points.
+class TpeOptimizer : public Optimizer
+{
+	public:
+		TpeOptimizer( const std::vector<SearchDimension>& dimensions,
+					  uint64_t seed );
+
+	protected:
+		void ProposePoints( int count,
+							std::vector< std::vector<double> >& points ) override;
+		void Learn( const std::vector< std::vector<double> >& points,
+					const std::vector<double>& scores ) override;
+
+	private:
+		double LogDensity( const std::vector<double>& point,
+						   const std::vector<int>& members,
+						   const std::vector<double>& bandwidths ) const;
+		void Bandwidths( const std::vector<int>& members,
+						 std::vector<double>& bandwidths ) const;
+		std::vector< std::vector<double> > points_;
+		std::vector<double> scores_;
+};
+
+//Optimizer for "random", "cmaes" or "tpe", nullptr for any other name
+std::unique_ptr<Optimizer> CreateOptimizer( const std::string& name,
+											const std::vector<SearchDimension>& dimensions,
+											uint64_t seed );
+
+#endif // OPTIMIZER_H
@@ -0,0 +1,97 @@
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include "opencv2/opencv.hpp"
+#include "polygon_averager_class.h"
+#include "lane_detect_processor.h"
+
+PolygonAverager::PolygonAverager( int samplestoaverage,
+								  int samplestokeep ):
+								  samples_( std::max(samplestokeep, 1) ),
+								  differences_( samples_.size() ),
+								  order_( samples_.size() ),
+								  samplestoaverage_{ std::min(std::max(samplestoaverage, 1),
+															  static_cast<int>(samples_.size())) }
+{
+	Reset();
+}
+
+void PolygonAverager::Average( Polygon& polygon )
+{
+	//Ring buffer, the oldest sample leaves the running sum as the new one enters
+	if ( count_ == samples_.size() ) {
+		Accumulate( samples_[next_], -1 );
+	} else {
+		count_++;
+	}
+	samples_[next_] = polygon;
+	Accumulate( polygon, 1 );
+	next_ = (next_ + 1) % samples_.size();
+	if ( nonzerocount_ == 0 ) return;
+
+	//Average nonzero
+	Polygon averagepolygon;
+	for ( int i = 0; i < averagepolygon.size(); i++ ) {
+		averagepolygon[i].x = sum_[i].x / nonzerocount_;
+		averagepolygon[i].y = sum_[i].y / nonzerocount_;
+	}
+
+	//if not enough nonzero polygons, return
+	if ( nonzerocount_ < samplestoaverage_ ) {
+		polygon = averagepolygon;
+		return;
+	}
+
+	//Find differences
+	for ( int i = 0; i < count_; i++ ) {
+		float differencefromaverage{0.0f};
+		for ( int j = 0; j < averagepolygon.size(); j++ ) {
+			differencefromaverage += fabs(averagepolygon[j].x - samples_[i][j].x);
+			differencefromaverage += fabs(averagepolygon[j].y - samples_[i][j].y);
+		}
+		differences_[i] = differencefromaverage;
+		order_[i] = i;
+	}
+
+	//Only the closest samplestoaverage need to be found, not put in order
+	std::nth_element( order_.begin(),
+					  order_.begin() + (samplestoaverage_ - 1),
+					  order_.begin() + count_,
+					  [this]( int a, int b )
+					  { return differences_[a] < differences_[b]; } );
+
+	//Average closest values
+	Polygon closestsum;
+	for ( int i = 0; i < samplestoaverage_; i++ ) {
+		for ( int j = 0; j < closestsum.size(); j++ ) {
+			closestsum[j] += samples_[order_[i]][j];
+		}
+	}
+	for ( int i = 0; i < polygon.size(); i++ ) {
+		polygon[i].x = closestsum[i].x / samplestoaverage_;
+		polygon[i].y = closestsum[i].y / samplestoaverage_;
+	}
+	return;
+}
+
+void PolygonAverager::Reset()
+{
+	next_ = 0;
+	count_ = 0;
+	nonzerocount_ = 0;
+	sum_.fill( cv::Point(0,0) );
+	return;
+}
+
+void PolygonAverager::Accumulate( const Polygon& polygon,
+								  int sign )
+{
+	//Undetected frames are kept in the ring but not in the sum
+	if ( polygon[0] == cv::Point(0,0) ) return;
+	nonzerocount_ += sign;
+	for ( int i = 0; i < polygon.size(); i++ ) {
+		sum_[i].x += sign * polygon[i].x;
+		sum_[i].y += sign * polygon[i].y;
+	}
+	return;
+}
@@ -0,0 +1,35 @@
+#ifndef POLYGONAVERAGER_H
+#define POLYGONAVERAGER_H
+
+#include <vector>
+#include "opencv2/opencv.hpp"
+#include "lane_detect_processor.h"
+
+//Smooths detected polygons over the last samplestokeep frames.  Once enough of them are
+//nonzero, the samplestoaverage polygons closest to the mean are averaged so single bad
+//detections are rejected.  All storage is sized at construction and a running sum is
+//kept, so nothing is allocated per frame.
+class PolygonAverager
+{
+	public:
+		PolygonAverager( int samplestoaverage,
+						 int samplestokeep );
+		void Average( Polygon& polygon );
+		void Reset();
+
+	protected:
+
+	private:
+		void Accumulate( const Polygon& polygon,
+						 int sign );
+		std::vector<Polygon> samples_;
+		std::vector<float> differences_;
+		std::vector<int> order_;
+		int samplestoaverage_;
+		int next_;
+		int count_;
+		int nonzerocount_;
+		Polygon sum_;
+};
+
+#endif // POLYGONAVERAGER_H
@@ -0,0 +1,265 @@
+//Times the fused preprocessing kernel against the cvtColor, blur and meanStdDev sequence
+//it replaces, and checks both give identical results.  Uses the first frame of the video
+//passed, or a random 800x480 frame if none is.
+//
+//    preprocess_benchmark [video] [--iterations=N]
+//    preprocess_benchmark video --verify [--frames=N] [--candidates=N]
+//
+//--verify instead checks the fast paths against straightforward references on every
+//frame of the video, or its first N, and exits non-zero on any mismatch:
+//  - fused preprocessing against cvtColor, blur and meanStdDev, bit for bit
+//  - the pruned, vectorized pair search against a full left by right scan with
+//    FindPolygon and Score, same polygon for the defaults and for N-1 random
+//    candidates drawn from the learner's ranges
+//  - the analytic PercentMatch against the rasterized one, within k_matchtolerance
+
+//Standard libraries
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <math.h>
+
+//3rd party libraries
+#include "opencv2/opencv.hpp"
+
+//Project headers
+#include "lane_detect_processor.h"
+#include "result_values_class.h"
+
+//Forward declarations
+int VerifyVideo( const std::string& filename,
+				 int maxframes,
+				 int candidatecount );
+void FindBestPolygonExhaustive( const std::vector<EvaluatedContour>& leftcontours,
+								const std::vector<EvaluatedContour>& rightcontours,
+								const int imagewidth,
+								const int imageheight,
+								const LaneDetectConstants& constants,
+								Polygon& polygon );
+
+/*****************************************************************************************/
+int main(int argc,char *argv[])
+{
+	//Split arguments into options and video file
+	int iterations{1000};
+	bool verify{false};
+	int maxframes{0};
+	int candidatecount{8};
+	std::string filename;
+	for (int i = 1; i < argc; i++ ) {
+		std::string argument{ argv[i] };
+		if ( argument.compare(0, 13, "--iterations=") == 0 ) {
+			iterations = std::stoi( argument.substr(13) );
+		} else if ( argument == "--verify" ) {
+			verify = true;
+		} else if ( argument.compare(0, 9, "--frames=") == 0 ) {
+			maxframes = std::stoi( argument.substr(9) );
+		} else if ( argument.compare(0, 13, "--candidates=") == 0 ) {
+			candidatecount = std::max( std::stoi(argument.substr(13)), 1 );
+		} else {
+			filename = argument;
+		}
+	}
+	if ( verify ) return VerifyVideo( filename, maxframes, candidatecount );
+
+	//Get frame
+	cv::Mat frame;
+	if ( !filename.empty() ) {
+		cv::VideoCapture capture(filename);
+		capture >> frame;
+		capture.release();
+	}
+	if ( frame.empty() ) {
+		frame.create( 480, 800, CV_8UC3 );
+		cv::randu( frame, cv::Scalar::all(0), cv::Scalar::all(256) );
+	}
+	std::cout << "Frame " << frame.cols << "x" << frame.rows << ", " << iterations
+			  << " iterations" << std::endl;
+
+	//Three separate full frame passes
+	cv::Mat grayimage;
+	cv::Mat separateblurred;
+	cv::Scalar mean;
+	cv::Scalar std;
+	std::chrono::high_resolution_clock::time_point starttime{
+		std::chrono::high_resolution_clock::now() };
+	for ( int i = 0; i < iterations; i++ ) {
+		cv::cvtColor( frame, grayimage, CV_BGR2GRAY );
+		cv::blur( grayimage, separateblurred, cv::Size(3,3) );
+		cv::meanStdDev( separateblurred, mean, std );
+	}
+	double separatetime{ std::chrono::duration_cast<std::chrono::microseconds>
+		(std::chrono::high_resolution_clock::now() - starttime).count() /
+		(1.0 * iterations) };
+
+	//Fused single pass
+	ProcessingWorkspace workspace;
+	cv::Mat fusedblurred;
+	double fusedstd{0.0};
+	starttime = std::chrono::high_resolution_clock::now();
+	for ( int i = 0; i < iterations; i++ ) {
+		PreprocessImageFused( frame, fusedblurred, workspace, &fusedstd );
+	}
+	double fusedtime{ std::chrono::duration_cast<std::chrono::microseconds>
+		(std::chrono::high_resolution_clock::now() - starttime).count() /
+		(1.0 * iterations) };
+
+	//Report
+	bool identical{ (cv::countNonZero(separateblurred != fusedblurred) == 0) &&
+					(fusedstd == std[0]) };
+	std::cout << std::fixed << std::setprecision(1);
+	std::cout << "cvtColor + blur + meanStdDev: " << separatetime << " us/frame" << std::endl;
+	std::cout << "Fused: " << fusedtime << " us/frame" << std::endl;
+	std::cout << std::setprecision(2) << "Speedup: " << (separatetime / fusedtime) << "x"
+			  << std::endl;
+	std::cout << "Results " << (identical ? "identical" : "DIFFER") << std::endl;
+
+	return identical ? 0 : 1;
+}
+
+/*****************************************************************************************/
+int VerifyVideo( const std::string& filename,
+				 int maxframes,
+				 int candidatecount )
+{
+	cv::VideoCapture capture(filename);
+	if ( !capture.isOpened() ) {
+		std::cout << "Verify needs a video" << std::endl;
+		return 1;
+	}
+	
+	//Defaults first, the rest drawn from the ranges main sweeps, same every run
+	std::vector<LaneDetectConstants> candidates( candidatecount );
+	std::mt19937 generator{ 1 };
+	auto uniform = [&generator]( double minimum, double maximum ) {
+		return std::uniform_real_distribution<double>( minimum, maximum )( generator );
+	};
+	for ( int c = 1; c < candidatecount; c++ ) {
+		LaneDetectConstants& candidate{ candidates[c] };
+		candidate.k_maxvanishingpointangle = uniform( 5.0, 40.0 );
+		candidate.k_weightedangleoffset = uniform( -10.0, -1.0 );
+		candidate.k_weightedcenteroffset = uniform( -10.0, -1.0 );
+		candidate.k_weightedheightwidth = uniform( 100.0, 400.0 );
+		candidate.k_lowestscorelimit = uniform( -500.0, 500.0 );
+		candidate.k_minimumpolygonheight = uniform( 5.0, 100.0 );
+		candidate.k_minimumsize = uniform( 10.0, 80.0 );
+		candidate.k_minimumangle = uniform( 20.0, 45.0 );
+		candidate.k_anglefromcenter = uniform( 5.0, 45.0 );
+		candidate.k_contrastscalefactor = uniform( 0.2, 0.4 );
+	}
+	
+	cv::Mat frame;
+	cv::Mat grayimage;
+	cv::Mat separateblurred;
+	cv::Mat fusedblurred;
+	cv::Scalar mean;
+	cv::Scalar std;
+	ProcessingWorkspace workspace;
+	ProcessingCache cache;
+	std::unique_ptr<ResultValues> target;
+	int frames{0};
+	int preprocessmismatches{0};
+	int searchmismatches{0};
+	int matchmismatches{0};
+	int detected{0};
+	double maxmatcherror{0.0};
+	while ( (maxframes <= 0) || (frames < maxframes) ) {
+		capture >> frame;
+		if ( frame.empty() ) break;
+		if ( !target ) target.reset( new ResultValues(1, true, frame.size()) );
+		
+		//Fused preprocessing, exact
+		cv::cvtColor( frame, grayimage, CV_BGR2GRAY );
+		cv::blur( grayimage, separateblurred, cv::Size(3,3) );
+		cv::meanStdDev( separateblurred, mean, std );
+		double fusedstd{0.0};
+		PreprocessImageFused( frame, fusedblurred, workspace, &fusedstd );
+		if ( (cv::countNonZero(separateblurred != fusedblurred) != 0) ||
+			 (fusedstd != std[0]) ) preprocessmismatches++;
+		
+		//Each candidate's pair search against the full scan of the same sorted contours
+		cache.Invalidate();
+		for ( const LaneDetectConstants& candidate : candidates ) {
+			Polygon polygon;
+			ProcessBlurredImage( separateblurred, candidate, polygon, &cache, &workspace );
+			LaneDetectConstants scaledconstants;
+			const LaneDetectConstants& constants{ ScaleLaneDetectConstants(candidate,
+																		   separateblurred.size(),
+																		   scaledconstants) };
+			Polygon referencepolygon;
+			FindBestPolygonExhaustive( cache.leftcontours,
+									   cache.rightcontours,
+									   cache.imagewidth,
+									   cache.imageheight,
+									   constants,
+									   referencepolygon );
+			if ( polygon != referencepolygon ) searchmismatches++;
+			if ( polygon[0] == cv::Point(0,0) ) continue;
+			
+			//Analytic match within tolerance of the raster
+			detected++;
+			double error{ fabs(PercentMatch(polygon, target->optimalpolygon_, frame.size()) -
+							   PercentMatchRaster(polygon, target->optimalmat_)) };
+			maxmatcherror = std::max( maxmatcherror, error );
+			if ( error > k_matchtolerance ) matchmismatches++;
+		}
+		frames++;
+	}
+	capture.release();
+	
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << frames << " frames, " << candidatecount << " candidates, " << detected
+			  << " detected polygons" << std::endl;
+	std::cout << "Preprocessing mismatches: " << preprocessmismatches << std::endl;
+	std::cout << "Pair search mismatches: " << searchmismatches << std::endl;
+	std::cout << "Match mismatches: " << matchmismatches << ", largest error "
+			  << maxmatcherror << " of " << k_matchtolerance << " allowed" << std::endl;
+	bool passed{ (frames > 0) && (preprocessmismatches == 0) && (searchmismatches == 0) &&
+				 (matchmismatches == 0) };
+	std::cout << "Verify " << (passed ? "passed" : "FAILED") << std::endl;
+	
+	return passed ? 0 : 1;
+}
+
+/*****************************************************************************************/
+void FindBestPolygonExhaustive( const std::vector<EvaluatedContour>& leftcontours,
+								const std::vector<EvaluatedContour>& rightcontours,
+								const int imagewidth,
+								const int imageheight,
+								const LaneDetectConstants& constants,
+								Polygon& polygon )
+{
+	//Every left by right pair through the scalar checks, as before the pair index
+	polygon.fill( cv::Point(0,0) );
+	float maxscore{ constants.k_lowestscorelimit };
+	int bestleft{ -1 };
+	int bestright{ -1 };
+	for ( int i = 0; i < leftcontours.size(); i++ ) {
+		for ( int j = 0; j < rightcontours.size(); j++ ) {
+			if ( (fabs(180.0f - leftcontours[i].angle - rightcontours[j].angle) * 0.5f) >
+				 constants.k_anglefromcenter ) continue;
+			Polygon newpolygon{ cv::Point(0,0),
+								cv::Point(0,0),
+								cv::Point(0,0),
+								cv::Point(0,0) };
+			FindPolygon( newpolygon, leftcontours[i], rightcontours[j], imageheight, constants );
+			if ( newpolygon[0] == cv::Point(0,0) ) continue;
+			float score{ Score(newpolygon, leftcontours[i], rightcontours[j], imagewidth, constants) };
+			if ( score > maxscore ) {
+				bestleft = i;
+				bestright = j;
+				maxscore = score;
+			}
+		}
+	}
+	if ( bestleft >= 0 ) {
+		FindPolygon( polygon, leftcontours[bestleft], rightcontours[bestright], imageheight,
+					 constants, true );
+	}
+	return;
+}
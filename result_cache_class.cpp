@@ -0,0 +1,145 @@
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include "result_cache_class.h"
+
+namespace {
+	const char k_cachemagic[8]{ 'L', 'D', 'R', 'E', 'S', 'U', 'L', 'T' };
+	const uint32_t k_cacheversion{ 2 };
+}
+
+ResultCache::ResultCache( const std::string& filename,
+						  uint64_t runhash ):
+						  recordcount_{0},
+						  iterationcount_{0},
+						  filename_{ filename },
+						  runhash_{ runhash }
+{
+}
+
+bool ResultCache::Load()
+{
+	std::ifstream file( filename_, std::ios::binary );
+	if ( !file.is_open() ) return false;
+	ResultCacheHeader header;
+	file.read( reinterpret_cast<char*>(&header), sizeof(header) );
+	if ( !file ||
+		 (std::memcmp(header.magic, k_cachemagic, sizeof(k_cachemagic)) != 0) ||
+		 (header.version != k_cacheversion) ||
+		 (header.runhash != runhash_) ) return false;
+
+	//All or nothing, a short file means it wasn't written by Save
+	std::map< std::vector<double>, ResultRecord > records;
+	std::map< uint64_t, std::pair<std::vector<double>, ResultRecord> > partialrecords;
+	std::vector<double> values( header.valuecount );
+	ResultRecord record;
+	for ( uint64_t i = 0; i < header.recordcount; i++ ) {
+		file.read( reinterpret_cast<char*>(values.data()), values.size() * sizeof(double) );
+		file.read( reinterpret_cast<char*>(&record), sizeof(record) );
+		if ( !file ) return false;
+		if ( record.complete ) {
+			records[values] = record;
+		} else {
+			partialrecords[record.iteration] = std::make_pair( values, record );
+		}
+	}
+	records_.swap( records );
+	partialrecords_.swap( partialrecords );
+	recordcount_ = records_.size() + partialrecords_.size();
+	iterationcount_ = header.iterationcount;
+
+	return true;
+}
+
+bool ResultCache::Save( uint64_t iterationcount )
+{
+	//Written beside the checkpoint and renamed over it, so a run killed mid write
+	//leaves the previous checkpoint intact
+	std::string tempfilename{ filename_ + ".tmp" };
+	std::ofstream file( tempfilename, std::ios::binary | std::ios::trunc );
+	if ( !file.is_open() ) return false;
+	ResultCacheHeader header;
+	std::memset( &header, 0, sizeof(header) );
+	std::memcpy( header.magic, k_cachemagic, sizeof(k_cachemagic) );
+	header.version = k_cacheversion;
+	header.valuecount = !records_.empty() ? records_.begin()->first.size() :
+						!partialrecords_.empty() ?
+							partialrecords_.begin()->second.first.size() : 0;
+	header.runhash = runhash_;
+	header.recordcount = records_.size() + partialrecords_.size();
+	header.iterationcount = iterationcount;
+	file.write( reinterpret_cast<const char*>(&header), sizeof(header) );
+	for ( const std::pair< const std::vector<double>, ResultRecord >& entry : records_ ) {
+		file.write( reinterpret_cast<const char*>(entry.first.data()),
+					entry.first.size() * sizeof(double) );
+		file.write( reinterpret_cast<const char*>(&entry.second), sizeof(entry.second) );
+	}
+	for ( const std::pair< const uint64_t, std::pair<std::vector<double>, ResultRecord> >&
+		  entry : partialrecords_ ) {
+		file.write( reinterpret_cast<const char*>(entry.second.first.data()),
+					entry.second.first.size() * sizeof(double) );
+		file.write( reinterpret_cast<const char*>(&entry.second.second),
+					sizeof(entry.second.second) );
+	}
+	file.close();
+	if ( !file ) {
+		std::remove( tempfilename.c_str() );
+		return false;
+	}
+
+	//Windows rename won't overwrite
+#ifdef _WIN32
+	std::remove( filename_.c_str() );
+#endif
+	if ( std::rename(tempfilename.c_str(), filename_.c_str()) != 0 ) {
+		std::remove( tempfilename.c_str() );
+		return false;
+	}
+	iterationcount_ = iterationcount;
+
+	return true;
+}
+
+bool ResultCache::Find( const std::vector<double>& values,
+						uint64_t iteration,
+						ResultRecord& record ) const
+{
+	//What this iteration saw first, even if the values were evaluated in full since
+	std::map< uint64_t, std::pair<std::vector<double>, ResultRecord> >::const_iterator
+		partial{ partialrecords_.find(iteration) };
+	if ( (partial != partialrecords_.end()) && (partial->second.first == values) ) {
+		record = partial->second.second;
+		return true;
+	}
+	std::map< std::vector<double>, ResultRecord >::const_iterator entry{
+		records_.find(values) };
+	if ( entry == records_.end() ) return false;
+	record = entry->second;
+	return true;
+}
+
+void ResultCache::Insert( const std::vector<double>& values,
+						  const ResultRecord& record )
+{
+	if ( record.complete ) {
+		records_[values] = record;
+	} else {
+		partialrecords_[record.iteration] = std::make_pair( values, record );
+	}
+	recordcount_ = records_.size() + partialrecords_.size();
+	return;
+}
+
+uint64_t ResultCache::Hash( const std::string& text )
+{
+	//FNV-1a, same as FrameStore::HashFile
+	uint64_t hash{ 14695981039346656037ULL };
+	for ( char c : text ) {
+		hash ^= static_cast<unsigned char>(c);
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
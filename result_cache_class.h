@@ -0,0 +1,66 @@
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+
+//Everything written to the results file for one evaluated candidate.  complete is 0
+//for a candidate successive halving dropped before it saw every frame.
+struct ResultRecord {
+	double averagematch;
+	double score;
+	double runtime;
+	double fps;
+	double maxmatcherror;
+	uint32_t detectedframes;
+	uint32_t frames;
+	int32_t rung;
+	uint32_t complete;
+	uint64_t iteration;
+};
+
+//On disk layout, recordcount entries of valuecount doubles then a ResultRecord follow
+struct ResultCacheHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t valuecount;
+	uint64_t runhash;
+	uint64_t recordcount;
+	uint64_t iterationcount;
+};
+
+//Results of every candidate evaluated so far, keyed by its swept values, doubling as
+//the checkpoint of a learning run.  Sweep and optimizer state is rebuilt on resume by
+//replaying the run from the start, every candidate already in the cache is then looked
+//up instead of evaluated.  runhash identifies the settings the results depend on, a
+//checkpoint from any other run is ignored.  A partial result only stands in for the
+//iteration that produced it, so replaying gives the same rows, while the same values
+//proposed at any other iteration are evaluated in full.
+class ResultCache
+{
+	public:
+		ResultCache( const std::string& filename,
+					 uint64_t runhash );
+		bool Load();
+		bool Save( uint64_t iterationcount );
+		bool Find( const std::vector<double>& values,
+				   uint64_t iteration,
+				   ResultRecord& record ) const;
+		void Insert( const std::vector<double>& values,
+					 const ResultRecord& record );
+		static uint64_t Hash( const std::string& text );
+		size_t recordcount_;
+		uint64_t iterationcount_;
+
+	protected:
+
+	private:
+		std::string filename_;
+		uint64_t runhash_;
+		std::map< std::vector<double>, ResultRecord > records_;
+		std::map< uint64_t, std::pair<std::vector<double>, ResultRecord> > partialrecords_;
+};
+
+#endif // RESULTCACHE_H
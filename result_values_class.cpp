@@ -1,12 +1,14 @@
 #include <deque>
+#include <vector>
 #include <math.h>
 #include "opencv2/opencv.hpp"
 #include "result_values_class.h"
 #include "lane_detect_processor.h"
 #include "lane_detect_constants.h"
 #include "lane_constant_class.h"
+#include "label_store_class.h"
 
-double Average( std::deque<float> &values )
+double Average( const std::deque<float> &values )
 {
 	double value{0.0};
 	if ( values.size() < 1 ) return value;
@@ -17,9 +19,125 @@ double Average( std::deque<float> &values )
 	return value;
 }
 
+/*****************************************************************************************/
+namespace {
+	//Weight of percent detected against average match in the score
+	const double k_lanedetectmultiplier{ 0.10 };
+	
+	//Both shapes are quadrilaterals, clipping against up to 4 more edges keeps this small
+	const int k_maxclippedpoints{ 16 };
+	
+	struct ClipPolygon {
+		cv::Point2d points[k_maxclippedpoints];
+		int count;
+	};
+
+	double Cross( const cv::Point2d& origin,
+				  const cv::Point2d& a,
+				  const cv::Point2d& b )
+	{
+		return (a.x - origin.x) * (b.y - origin.y) - (a.y - origin.y) * (b.x - origin.x);
+	}
+
+	double Area( const ClipPolygon& polygon )
+	{
+		double area{0.0};
+		for ( int i = 0; i < polygon.count; i++ ) {
+			const cv::Point2d& a{ polygon.points[i] };
+			const cv::Point2d& b{ polygon.points[(i + 1) % polygon.count] };
+			area += a.x * b.y - b.x * a.y;
+		}
+		return fabs(0.5 * area);
+	}
+
+	//Convex hull in counter clockwise order, also what fillConvexPoly effectively
+	//draws if the detected lines cross between top and bottom
+	ClipPolygon ConvexHull( const Polygon& polygon )
+	{
+		cv::Point2d sorted[4];
+		for ( int i = 0; i < 4; i++ ) {
+			sorted[i] = cv::Point2d( polygon[i].x, polygon[i].y );
+		}
+		std::sort( sorted,
+				   sorted + 4,
+				   []( const cv::Point2d& lhs, const cv::Point2d& rhs )
+				   { return (lhs.x < rhs.x) || ((lhs.x == rhs.x) && (lhs.y < rhs.y)); } );
+		ClipPolygon hull;
+		hull.count = 0;
+		for ( int i = 0; i < 4; i++ ) {
+			while ( (hull.count >= 2) &&
+					(Cross(hull.points[hull.count - 2],
+						   hull.points[hull.count - 1],
+						   sorted[i]) <= 0.0) ) hull.count--;
+			hull.points[hull.count++] = sorted[i];
+		}
+		int lowercount{ hull.count + 1 };
+		for ( int i = 2; i >= 0; i-- ) {
+			while ( (hull.count >= lowercount) &&
+					(Cross(hull.points[hull.count - 2],
+						   hull.points[hull.count - 1],
+						   sorted[i]) <= 0.0) ) hull.count--;
+			hull.points[hull.count++] = sorted[i];
+		}
+		hull.count--;
+		return hull;
+	}
+
+	//Sutherland-Hodgman, clip must be convex and counter clockwise
+	ClipPolygon Clip( const ClipPolygon& subject,
+					  const ClipPolygon& clip )
+	{
+		ClipPolygon output{ subject };
+		for ( int i = 0; (i < clip.count) && (output.count > 0); i++ ) {
+			const cv::Point2d& edgestart{ clip.points[i] };
+			const cv::Point2d& edgeend{ clip.points[(i + 1) % clip.count] };
+			ClipPolygon input{ output };
+			output.count = 0;
+			for ( int j = 0; j < input.count; j++ ) {
+				const cv::Point2d& current{ input.points[j] };
+				const cv::Point2d& previous{ input.points[(j + input.count - 1) %
+														  input.count] };
+				double currentside{ Cross(edgestart, edgeend, current) };
+				double previousside{ Cross(edgestart, edgeend, previous) };
+				if ( (currentside >= 0.0) != (previousside >= 0.0) ) {
+					double t{ previousside / (previousside - currentside) };
+					output.points[output.count++] = previous + (current - previous) * t;
+				}
+				if ( currentside >= 0.0 ) output.points[output.count++] = current;
+			}
+		}
+		return output;
+	}
+}
+
 /*****************************************************************************************/
 float PercentMatch( const Polygon& polygon,
-					const cv::Mat& optimalmat )
+					const Polygon& optimalpolygon,
+					const cv::Size imagesize )
+{
+	//Exact areas, both shapes limited to the image like the raster version
+	ClipPolygon image;
+	image.count = 4;
+	image.points[0] = cv::Point2d( 0.0, 0.0 );
+	image.points[1] = cv::Point2d( imagesize.width, 0.0 );
+	image.points[2] = cv::Point2d( imagesize.width, imagesize.height );
+	image.points[3] = cv::Point2d( 0.0, imagesize.height );
+	ClipPolygon polygonclipped{ Clip(ConvexHull(polygon), image) };
+	ClipPolygon optimalclipped{ Clip(ConvexHull(optimalpolygon), image) };
+	if ( optimalclipped.count < 3 ) return 0.0f;
+	double overlaparea{ 0.0 };
+	if ( polygonclipped.count >= 3 ) {
+		overlaparea = Area( Clip(polygonclipped, optimalclipped) );
+	}
+	double unionarea{ Area(polygonclipped) + Area(optimalclipped) - overlaparea };
+	if ( unionarea <= 0.0 ) return 0.0f;
+	
+	return (100.0 * overlaparea) / unionarea;
+}
+
+/*****************************************************************************************/
+float PercentMatchRaster( const Polygon& polygon,
+						  const cv::Mat& optimalmat )
 {
 	//Create blank mat
 	cv::Mat polygonmat{ cv::Mat(optimalmat.rows,
@@ -60,26 +178,41 @@ float PercentMatch( const Polygon& polygon,
 	return (100.0f * overlaparea) / (overlaparea + excessarea);
 }
 
-ResultValues::ResultValues( uint32_t totalframes ):
+ResultValues::ResultValues( uint32_t totalframes,
+							bool validatematch,
+							cv::Size framesize ):
 							totalframes_{totalframes},
+							validatematch_{validatematch},
+							maxmatcherror_{0.0},
+							logframes_{false},
+							labels_{nullptr},
 							detectedframes_{0},
+							evaluatedframes_{0},
 							previousscore_{0.0},
 							score_{0.0},
 							averagematch_{0.0},
 							lanedetectmultiplier_{0.0},
 							firstpass_{true},
-							optimalmat_{480,
-										800,
+							optimalmat_{framesize.height,
+										framesize.width,
 										CV_8UC1,
-										cv::Scalar(0)}
+										cv::Scalar(0)},
+							optimalpolygon_{ cv::Point(110,480),
+											 cv::Point(690,480),
+											 cv::Point(410,250),
+											 cv::Point(390,250) }
 {
+	//Target is given for the reference frame, scale it to the frames evaluated
+	for ( cv::Point& point : optimalpolygon_ ) {
+		point = cv::Point( (point.x * framesize.width) / k_referencewidth,
+						   (point.y * framesize.height) / k_referenceheight );
+	}
+	
+	//Raster target only needed to validate the analytic match
+	if ( !validatematch_ ) return;
 	cv::Point cvpointarray[4];
-	Polygon optimalpolygon{ cv::Point(110,480),
-							cv::Point(690,480),
-							cv::Point(390,250),
-							cv::Point(410,250) };
 	for  (int i =0; i < 4; i++ ) {
-		cvpointarray[i] = optimalpolygon[i];
+		cvpointarray[i] = optimalpolygon_[i];
 	}
 	cv::fillConvexPoly( optimalmat_, cvpointarray, 4,  cv::Scalar(1) );
 }
@@ -87,7 +220,9 @@ ResultValues::ResultValues( uint32_t totalframes ):
 void ResultValues::NewIteration()
 {
 	detectedframes_ = 0;
+	evaluatedframes_ = 0;
 	matchqueue_.clear();
+	frameresults_.clear();
 	return;
 }
 
@@ -98,16 +233,78 @@ void ResultValues::NewVariable()
 	return;
 }
 
-void ResultValues::Push(Polygon polygon)
+void ResultValues::Push( Polygon polygon,
+						 uint32_t frame )
 {
-	if ( polygon[0] != cv::Point(0,0) ) {
+	evaluatedframes_++;
+	bool detected{ polygon[0] != cv::Point(0,0) };
+	float match{0.0f};
+	if ( detected ) {
 		detectedframes_++;
-		matchqueue_.push_back(PercentMatch(polygon, optimalmat_));
+		//Labelled frames are matched against their own target, looked up in place
+		const Polygon& target{ (labels_ != nullptr) ? labels_->Target(frame) :
+													  optimalpolygon_ };
+		match = PercentMatch( polygon,
+							  target,
+							  cv::Size(optimalmat_.cols, optimalmat_.rows) );
+		matchqueue_.push_back(match);
+		if ( validatematch_ ) {
+			const cv::Mat* targetmat{ &optimalmat_ };
+			if ( labels_ != nullptr ) {
+				labelmat_.create( optimalmat_.rows, optimalmat_.cols, CV_8UC1 );
+				labelmat_.setTo( cv::Scalar(0) );
+				cv::Point cvpointarray[4];
+				for  (int i =0; i < 4; i++ ) {
+					cvpointarray[i] = target[i];
+				}
+				cv::fillConvexPoly( labelmat_, cvpointarray, 4,  cv::Scalar(1) );
+				targetmat = &labelmat_;
+			}
+			double error{ fabs(match - PercentMatchRaster(polygon, *targetmat)) };
+			if ( error > maxmatcherror_ ) maxmatcherror_ = error;
+		}
 	}
+	if ( logframes_ ) frameresults_.push_back( FrameResult{ frame, match, detected, polygon } );
 	
 	return;
 }
 
+void ResultValues::Merge( const ResultValues& partial )
+{
+	//Appending keeps per frame order, so averages match a single accumulator
+	detectedframes_ += partial.detectedframes_;
+	evaluatedframes_ += partial.evaluatedframes_;
+	matchqueue_.insert( matchqueue_.end(),
+						partial.matchqueue_.begin(),
+						partial.matchqueue_.end() );
+	frameresults_.insert( frameresults_.end(),
+						  partial.frameresults_.begin(),
+						  partial.frameresults_.end() );
+	if ( partial.maxmatcherror_ > maxmatcherror_ ) maxmatcherror_ = partial.maxmatcherror_;
+	
+	return;
+}
+
+double ResultValues::PartialScore() const
+{
+	//Over the frames actually pushed, so candidates that have seen the same subset of
+	//frames can be ranked
+	return ScoreOver( evaluatedframes_ );
+}
+
+double ResultValues::ScoreOver( uint32_t frames ) const
+{
+	//Same weighting as Update
+	if ( frames == 0 ) return 0.0;
+	return k_lanedetectmultiplier * ((100.0 * detectedframes_) / (1.0 * frames)) +
+		   (1.0 - k_lanedetectmultiplier) * AverageMatch();
+}
+
+double ResultValues::AverageMatch() const
+{
+	return Average( matchqueue_ );
+}
+
 void ResultValues::Update(LaneConstant& laneconstant)
 {
 	//Check for first iteration for this variable
@@ -120,7 +317,7 @@ void ResultValues::Update(LaneConstant& laneconstant)
 	averagematch_ = Average(matchqueue_);
 	if ( firstpass_ ) {
 		//Hardcoded now to tip balance to good average match
-		lanedetectmultiplier_ = 0.10;
+		lanedetectmultiplier_ = k_lanedetectmultiplier;
 		/*
 		//Adjust detected frame multiplier to bring inital score to 0!
 		lanedetectmultiplier_ = averagematch_ * (static_cast<double>(totalframes_)
@@ -2,22 +2,56 @@
 #define RESULTVALUES_H
 
 #include <deque>
+#include <vector>
 #include "opencv2/opencv.hpp"
 #include "lane_detect_processor.h"
 
+//Percent overlap over union of the two quadrilaterals.  Computed exactly by clipping
+//their convex hulls, validated against the rasterized PercentMatchRaster to within
+//k_matchtolerance points.
+const double k_matchtolerance{ 1.0 };
+float PercentMatch( const Polygon& polygon,
+					const Polygon& optimalpolygon,
+					const cv::Size imagesize );
+float PercentMatchRaster( const Polygon& polygon,
+						  const cv::Mat& optimalmat );
+
+//One frame's result, kept for the frame log when logframes_ is set.  Frame is the index
+//over all files.
+struct FrameResult {
+	uint32_t frame;
+	float match;
+	bool detected;
+	Polygon polygon;
+};
+
 class LaneConstant;
+class LabelStore;
 class ResultValues
 {
 	public:
-		ResultValues( uint32_t totalframes );
-		void Push(Polygon polygon);
+		ResultValues( uint32_t totalframes,
+					  bool validatematch = false,
+					  cv::Size framesize = cv::Size(k_referencewidth, k_referenceheight) );
+		void Push( Polygon polygon,
+				   uint32_t frame = 0 );
+		void Merge( const ResultValues& partial );
 		void Update( LaneConstant& laneconstant );
 		void NewIteration();
 		void NewVariable();
+		double PartialScore() const;
+		double ScoreOver( uint32_t frames ) const;
+		double AverageMatch() const;
 		double averagematch_;
 		double outputscore_;
 		uint32_t detectedframes_;
+		uint32_t evaluatedframes_;
 		cv::Mat optimalmat_;
+		Polygon optimalpolygon_;
+		double maxmatcherror_;
+		bool logframes_;
+		std::vector<FrameResult> frameresults_;
+		const LabelStore* labels_;
 
 	protected:
 
@@ -27,7 +61,9 @@ class ResultValues
 		bool firstpass_;
 		double lanedetectmultiplier_;
 		uint32_t totalframes_;
+		bool validatematch_;
 		std::deque<float> matchqueue_;
+		cv::Mat labelmat_;
 };
 
 #endif // RESULTVALUES_H
@@ -0,0 +1,75 @@
+#include <vector>
+#include <atomic>
+#include "opencv2/opencv.hpp"
+#include "stage_cache_class.h"
+#include "lane_detect_processor.h"
+
+namespace {
+	template <typename T>
+	uint64_t VectorBytes( const std::vector<T>& values )
+	{
+		return values.capacity() * sizeof(T);
+	}
+
+	uint64_t TableBytes( const ContourTable& table )
+	{
+		return VectorBytes(table.index) + VectorBytes(table.centerx) +
+			   VectorBytes(table.centery) + VectorBytes(table.slopeinverse) +
+			   VectorBytes(table.angle) + VectorBytes(table.miny) +
+			   VectorBytes(table.maxy) + VectorBytes(table.bottomx);
+	}
+
+	//Heap held by the cache, capacities since cleared vectors keep theirs
+	uint64_t CacheBytes( const ProcessingCache& cache )
+	{
+		uint64_t bytes{ VectorBytes(cache.detectedcontours) };
+		for ( const Contour& contour : cache.detectedcontours ) {
+			bytes += VectorBytes( contour );
+		}
+		bytes += VectorBytes( cache.detectedhierarchy );
+		bytes += VectorBytes( cache.evaluatedchildsegments );
+		bytes += VectorBytes( cache.evaluatedparentsegments );
+		bytes += VectorBytes( cache.leftcontours );
+		bytes += VectorBytes( cache.rightcontours );
+		bytes += TableBytes( cache.pairindex.left );
+		bytes += TableBytes( cache.pairindex.rightbyangle );
+		bytes += TableBytes( cache.pairindex.rightbybottomx );
+		return bytes;
+	}
+}
+
+StageCache::StageCache( size_t framecount,
+						uint64_t budgetbytes ):
+						usedbytes_{ framecount * sizeof(ProcessingCache) },
+						releasedframes_{0},
+						caches_( framecount ),
+						framebytes_( framecount, 0 ),
+						released_( framecount, 0 ),
+						budgetbytes_{ budgetbytes }
+{
+}
+
+ProcessingCache* StageCache::Frame( uint32_t index )
+{
+	if ( (index >= caches_.size()) || released_[index] ) return nullptr;
+	return &caches_[index];
+}
+
+void StageCache::Account( uint32_t index )
+{
+	if ( (index >= caches_.size()) || released_[index] ) return;
+	uint64_t bytes{ CacheBytes(caches_[index]) };
+	uint64_t used{ usedbytes_.fetch_add(bytes - framebytes_[index]) +
+				   (bytes - framebytes_[index]) };
+	framebytes_[index] = bytes;
+	if ( used <= budgetbytes_ ) return;
+
+	//Over budget, this frame gives its memory back for good
+	caches_[index] = ProcessingCache();
+	usedbytes_ -= bytes;
+	framebytes_[index] = 0;
+	released_[index] = 1;
+	releasedframes_++;
+
+	return;
+}
@@ -0,0 +1,34 @@
+#ifndef STAGECACHE_H
+#define STAGECACHE_H
+
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include "lane_detect_processor.h"
+
+//Stage results of every cached frame, held within a byte budget.  What a frame's cache
+//holds depends on its contours, so it is measured after each use, and a frame whose
+//cache takes the total over the budget is released and processed uncached from then
+//on.  A frame may only be used by one thread at a time.
+class StageCache
+{
+	public:
+		StageCache( size_t framecount,
+					uint64_t budgetbytes );
+		ProcessingCache* Frame( uint32_t index );
+		void Account( uint32_t index );
+		std::atomic<uint64_t> usedbytes_;
+		std::atomic<uint32_t> releasedframes_;
+
+	protected:
+
+	private:
+		StageCache( const StageCache& ) = delete;
+		StageCache& operator=( const StageCache& ) = delete;
+		std::vector<ProcessingCache> caches_;
+		std::vector<uint64_t> framebytes_;
+		std::vector<uint8_t> released_;
+		uint64_t budgetbytes_;
+};
+
+#endif // STAGECACHE_H
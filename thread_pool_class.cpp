@@ -0,0 +1,128 @@
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <algorithm>
+#include "thread_pool_class.h"
+
+ThreadPool::ThreadPool( int threadcount ):
+						threadcount_{ threadcount },
+						function_{nullptr},
+						generation_{0},
+						activeworkers_{0},
+						stop_{false}
+{
+	if ( threadcount_ < 1 ) {
+		threadcount_ = std::max( static_cast<int>(std::thread::hardware_concurrency()), 1 );
+	}
+	for ( int i = 0; i < threadcount_; i++ ) {
+		queues_.push_back( std::unique_ptr<TaskQueue>(new TaskQueue()) );
+	}
+	for ( int i = 1; i < threadcount_; i++ ) {
+		workers_.push_back( std::thread(&ThreadPool::WorkerThread, this, i) );
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		stop_ = true;
+	}
+	startcondition_.notify_all();
+	for ( std::thread& worker : workers_ ) {
+		worker.join();
+	}
+}
+
+void ThreadPool::ParallelFor( int taskcount,
+							  const std::function<void(int task, int thread)>& function )
+{
+	if ( taskcount <= 0 ) return;
+
+	//Contiguous blocks keep neighbouring frames on one thread until stealing starts
+	for ( int i = 0; i < threadcount_; i++ ) {
+		int first{ static_cast<int>((static_cast<int64_t>(taskcount) * i) / threadcount_) };
+		int last{ static_cast<int>((static_cast<int64_t>(taskcount) * (i + 1)) / threadcount_) };
+		std::lock_guard<std::mutex> lock( queues_[i]->mutex );
+		for ( int task = first; task < last; task++ ) {
+			queues_[i]->tasks.push_back( task );
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		function_ = &function;
+		activeworkers_ = threadcount_ - 1;
+		generation_++;
+	}
+	startcondition_.notify_all();
+	RunTasks( 0 );
+
+	//Wait for workers still finishing stolen or own tasks
+	std::unique_lock<std::mutex> lock( mutex_ );
+	donecondition_.wait( lock, [this]{ return activeworkers_ == 0; } );
+	function_ = nullptr;
+
+	return;
+}
+
+void ThreadPool::WorkerThread( int thread )
+{
+	uint64_t seengeneration{0};
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock( mutex_ );
+			startcondition_.wait( lock, [this, seengeneration]
+								  { return stop_ || (generation_ != seengeneration); } );
+			if ( stop_ ) return;
+			seengeneration = generation_;
+		}
+		RunTasks( thread );
+		{
+			std::lock_guard<std::mutex> lock( mutex_ );
+			activeworkers_--;
+		}
+		donecondition_.notify_one();
+	}
+}
+
+void ThreadPool::RunTasks( int thread )
+{
+	int task;
+	while ( NextTask(thread, task) ) {
+		(*function_)( task, thread );
+	}
+	return;
+}
+
+bool ThreadPool::NextTask( int thread,
+						   int& task )
+{
+	//Own queue from the front
+	{
+		TaskQueue& queue{ *queues_[thread] };
+		std::lock_guard<std::mutex> lock( queue.mutex );
+		if ( !queue.tasks.empty() ) {
+			task = queue.tasks.front();
+			queue.tasks.pop_front();
+			return true;
+		}
+	}
+
+	//Steal from the back of the others
+	for ( int i = 1; i < threadcount_; i++ ) {
+		TaskQueue& queue{ *queues_[(thread + i) % threadcount_] };
+		std::lock_guard<std::mutex> lock( queue.mutex );
+		if ( !queue.tasks.empty() ) {
+			task = queue.tasks.back();
+			queue.tasks.pop_back();
+			return true;
+		}
+	}
+
+	return false;
+}
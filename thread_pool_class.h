@@ -0,0 +1,48 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+
+//Fixed set of worker threads running indexed tasks.  Each thread starts with a
+//contiguous block of task indices and steals from the back of other threads' queues
+//once its own is empty.  The calling thread takes part as thread 0.
+class ThreadPool
+{
+	public:
+		ThreadPool( int threadcount );
+		~ThreadPool();
+		void ParallelFor( int taskcount,
+						  const std::function<void(int task, int thread)>& function );
+		int threadcount_;
+
+	protected:
+
+	private:
+		struct TaskQueue {
+			std::mutex mutex;
+			std::deque<int> tasks;
+		};
+		ThreadPool( const ThreadPool& ) = delete;
+		ThreadPool& operator=( const ThreadPool& ) = delete;
+		void WorkerThread( int thread );
+		void RunTasks( int thread );
+		bool NextTask( int thread,
+					   int& task );
+		std::vector<std::thread> workers_;
+		std::vector< std::unique_ptr<TaskQueue> > queues_;
+		const std::function<void(int, int)>* function_;
+		std::mutex mutex_;
+		std::condition_variable startcondition_;
+		std::condition_variable donecondition_;
+		uint64_t generation_;
+		int activeworkers_;
+		bool stop_;
+};
+
+#endif // THREADPOOL_H
@@ -0,0 +1,308 @@
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <string>
+#include <algorithm>
+#include <new>
+#include "opencv2/opencv.hpp"
+#include "worker_coordinator_class.h"
+#include "lane_detect_processor.h"
+
+#ifdef __linux__
+	#include <sched.h>
+	#include <sys/prctl.h>
+	#include <semaphore.h>
+	#include <signal.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <sys/wait.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <time.h>
+	#include <errno.h>
+#endif
+
+namespace {
+	//Frames per task taken from the queue, and the most a block or pass can hold
+	const int k_workframespertask{ 16 };
+	const int k_maxworkframes{ 65536 };
+	const int k_maxworkcandidates{ 1024 };
+	const int k_maxworkers{ 256 };
+	
+	//Shared polygon results, frame major, blocks shrink as candidates grow to fit
+	const size_t k_polygonbytes{ 64 * 1024 * 1024 };
+}
+
+#ifdef __linux__
+//Lives at the start of the shared mapping, polygons follow it.  Written by the
+//coordinator only while every worker is waiting on start, the semaphores order those
+//writes before the workers' reads and the workers' results before the coordinator's.
+//Each worker has a contiguous range of tasks and steals from the others' once its own
+//is done, so while the frames of a block stay the same each frame keeps going to the
+//same worker and hits in its stage caches.
+struct WorkQueue {
+	sem_t start;
+	sem_t done;
+	std::atomic<uint32_t> nexttask[k_maxworkers];
+	uint32_t taskcount;
+	uint32_t framecount;
+	uint32_t candidatecount;
+	uint32_t stop;
+	LaneDetectConstants candidates[k_maxworkcandidates];
+	uint32_t frames[k_maxworkframes];
+};
+#else
+struct WorkQueue {};
+#endif
+
+WorkerCoordinator::WorkerCoordinator():
+									 workercount_{0},
+									 queue_{nullptr},
+									 polygons_{nullptr},
+									 mappingsize_{0},
+									 stagecachebytes_{0},
+									 stagecache_{nullptr},
+									 workerindex_{0}
+{
+}
+
+WorkerCoordinator::~WorkerCoordinator()
+{
+	Stop();
+}
+
+bool WorkerCoordinator::Start( int workercount,
+							   const std::vector<cv::Mat>& frames,
+							   uint64_t stagecachebytes )
+{
+#ifdef __linux__
+	Stop();
+	if ( (workercount < 1) || frames.empty() ) return false;
+	frames_ = frames;
+	stagecachebytes_ = stagecachebytes;
+	
+	//Anonymous once mapped, nothing is left in /dev/shm however the run ends
+	std::string name{ "/lanedetect-" + std::to_string(getpid()) };
+	int file{ shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600) };
+	if ( file < 0 ) return false;
+	shm_unlink( name.c_str() );
+	size_t queuebytes{ (sizeof(WorkQueue) + 63) & ~static_cast<size_t>(63) };
+	mappingsize_ = queuebytes + k_polygonbytes;
+	if ( ftruncate(file, mappingsize_) != 0 ) {
+		close( file );
+		return false;
+	}
+	void* mapping{ mmap(nullptr, mappingsize_, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0) };
+	close( file );
+	if ( mapping == MAP_FAILED ) return false;
+	queue_ = new (mapping) WorkQueue();
+	polygons_ = reinterpret_cast<Polygon*>( static_cast<char*>(mapping) + queuebytes );
+	sem_init( &queue_->start, 1, 0 );
+	sem_init( &queue_->done, 1, 0 );
+	
+	//Split the cores this process may run on into contiguous sets, one per worker
+	cpu_set_t allowed;
+	CPU_ZERO( &allowed );
+	sched_getaffinity( 0, sizeof(allowed), &allowed );
+	std::vector<int> cores;
+	for ( int core = 0; core < CPU_SETSIZE; core++ ) {
+		if ( CPU_ISSET(core, &allowed) ) cores.push_back( core );
+	}
+	workercount = std::min( std::min(workercount, static_cast<int>(cores.size())),
+							k_maxworkers );
+	workercount_ = workercount;
+	for ( int worker = 0; worker < workercount; worker++ ) {
+		std::vector<int> workercores( cores.begin() + (worker * cores.size()) / workercount,
+									  cores.begin() + ((worker + 1) * cores.size()) / workercount );
+		pid_t pid{ fork() };
+		if ( pid == 0 ) {
+			//Child never returns into the learner, and must not flush its buffers
+			workerindex_ = worker;
+			WorkerMain( workercores );
+			_exit( 0 );
+		}
+		if ( pid < 0 ) {
+			Stop();
+			return false;
+		}
+		workers_.push_back( pid );
+	}
+	
+	return true;
+#else
+	return false;
+#endif
+}
+
+int WorkerCoordinator::BlockFrames( int candidatecount ) const
+{
+	if ( (workercount_ == 0) || (candidatecount < 1) ||
+		 (candidatecount > k_maxworkcandidates) ) return 0;
+	size_t blockframes{ k_polygonbytes / (candidatecount * sizeof(Polygon)) };
+	return static_cast<int>( std::min(blockframes, static_cast<size_t>(k_maxworkframes)) );
+}
+
+bool WorkerCoordinator::Run( const std::vector<LaneDetectConstants>& candidates,
+							 const uint32_t* frameindices,
+							 int framecount )
+{
+#ifdef __linux__
+	if ( (framecount < 1) || (framecount > BlockFrames(candidates.size())) ) return false;
+	std::copy( candidates.begin(), candidates.end(), queue_->candidates );
+	std::copy( frameindices, frameindices + framecount, queue_->frames );
+	queue_->candidatecount = candidates.size();
+	queue_->framecount = framecount;
+	queue_->taskcount = (framecount + k_workframespertask - 1) / k_workframespertask;
+	for ( int worker = 0; worker < workercount_; worker++ ) {
+		queue_->nexttask[worker].store( TaskBegin(worker) );
+	}
+	for ( int worker = 0; worker < workercount_; worker++ ) {
+		sem_post( &queue_->start );
+	}
+	return WaitForWorkers();
+#else
+	return false;
+#endif
+}
+
+const Polygon* WorkerCoordinator::Polygons() const
+{
+	return polygons_;
+}
+
+void WorkerCoordinator::Stop()
+{
+#ifdef __linux__
+	if ( queue_ == nullptr ) return;
+	queue_->stop = 1;
+	for ( int worker = 0; worker < workers_.size(); worker++ ) {
+		sem_post( &queue_->start );
+	}
+	for ( pid_t pid : workers_ ) {
+		waitpid( pid, nullptr, 0 );
+	}
+	workers_.clear();
+	sem_destroy( &queue_->start );
+	sem_destroy( &queue_->done );
+	munmap( queue_, mappingsize_ );
+	queue_ = nullptr;
+	polygons_ = nullptr;
+	mappingsize_ = 0;
+	workercount_ = 0;
+#endif
+	return;
+}
+
+void WorkerCoordinator::WorkerMain( const std::vector<int>& cores )
+{
+#ifdef __linux__
+	//Only the pinned cores, threads started below inherit the mask
+	cpu_set_t set;
+	CPU_ZERO( &set );
+	for ( int core : cores ) {
+		CPU_SET( core, &set );
+	}
+	sched_setaffinity( 0, sizeof(set), &set );
+	
+	//Die with the coordinator even if it never gets to stop
+	prctl( PR_SET_PDEATHSIG, SIGKILL );
+	
+	//Stage caches are built here rather than inherited, so workers never hold more
+	//than their share between them
+	StageCache stagecache{ stagecachebytes_ > 0 ? frames_.size() : 0,
+						   stagecachebytes_ / workercount_ };
+	stagecache_ = &stagecache;
+	for(;;) {
+		while ( (sem_wait(&queue_->start) != 0) && (errno == EINTR) ) {}
+		if ( queue_->stop ) return;
+		std::vector<LaneDetectConstants> candidates( queue_->candidates,
+													 queue_->candidates +
+													 queue_->candidatecount );
+		std::vector<std::thread> threads;
+		for ( int i = 1; i < cores.size(); i++ ) {
+			threads.push_back( std::thread(&WorkerCoordinator::WorkerThread, this,
+										   std::cref(candidates)) );
+		}
+		WorkerThread( candidates );
+		for ( std::thread& thread : threads ) {
+			thread.join();
+		}
+		sem_post( &queue_->done );
+	}
+#endif
+	return;
+}
+
+void WorkerCoordinator::WorkerThread( const std::vector<LaneDetectConstants>& candidates )
+{
+#ifdef __linux__
+	ProcessingWorkspace workspace;
+	std::vector<Polygon>& polygons{ workspace.polygons };
+	const uint32_t candidatecount{ queue_->candidatecount };
+	
+	//Own range first, then the others' in turn
+	for ( int i = 0; i < workercount_; i++ ) {
+		int victim{ (workerindex_ + i) % workercount_ };
+		uint32_t end{ TaskBegin(victim + 1) };
+		for(;;) {
+			uint32_t task{ queue_->nexttask[victim].fetch_add(1) };
+			if ( task >= end ) break;
+			uint32_t first{ task * k_workframespertask };
+			uint32_t last{ std::min(first + k_workframespertask, queue_->framecount) };
+			for ( uint32_t slot = first; slot < last; slot++ ) {
+				uint32_t frameindex{ queue_->frames[slot] };
+				ProcessingCache* cache{ nullptr };
+				if ( stagecache_ != nullptr ) cache = stagecache_->Frame( frameindex );
+				ProcessBlurredImageBatch( frames_[frameindex],
+										  candidates,
+										  polygons,
+										  cache,
+										  &workspace );
+				if ( cache != nullptr ) stagecache_->Account( frameindex );
+				std::copy( polygons.begin(), polygons.end(),
+						   polygons_ + static_cast<size_t>(slot) * candidatecount );
+			}
+		}
+	}
+#endif
+	return;
+}
+
+uint32_t WorkerCoordinator::TaskBegin( int worker ) const
+{
+	return static_cast<uint32_t>( (static_cast<uint64_t>(worker) * queue_->taskcount) /
+								  workercount_ );
+}
+
+bool WorkerCoordinator::WaitForWorkers()
+{
+#ifdef __linux__
+	//A worker that died would never post, check on them while waiting
+	int finished{0};
+	while ( finished < workercount_ ) {
+		timespec deadline;
+		clock_gettime( CLOCK_REALTIME, &deadline );
+		deadline.tv_sec += 1;
+		if ( sem_timedwait(&queue_->done, &deadline) == 0 ) {
+			finished++;
+			continue;
+		}
+		if ( errno == EINTR ) continue;
+		for ( pid_t pid : workers_ ) {
+			if ( waitpid(pid, nullptr, WNOHANG) != 0 ) {
+				for ( pid_t other : workers_ ) {
+					kill( other, SIGKILL );
+					waitpid( other, nullptr, 0 );
+				}
+				workers_.clear();
+				Stop();
+				return false;
+			}
+		}
+	}
+	return true;
+#else
+	return false;
+#endif
+}
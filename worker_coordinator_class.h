@@ -0,0 +1,56 @@
+#ifndef WORKERCOORDINATOR_H
+#define WORKERCOORDINATOR_H
+
+#include <vector>
+#include "opencv2/opencv.hpp"
+#include "lane_detect_constants.h"
+#include "lane_detect_processor.h"
+#include "stage_cache_class.h"
+
+struct WorkQueue;
+
+//Forks worker processes that process cached frames for the learner, so a pass is not
+//limited to the memory bandwidth of the socket one process runs on.  Each worker is
+//pinned to its own contiguous share of the allowed cores and runs a thread per core.
+//Candidates, the frames of a block and the resulting polygons are exchanged through a
+//work queue in shared memory, workers taking tasks of k_workframespertask frames from
+//it as they go.  Frames are inherited through the fork, so Start must be called once
+//every frame is cached and before any thread is started, OpenCV's own included.  Each
+//worker keeps stage caches within its share of stagecachebytes.  Linux only, elsewhere
+//Start fails and the learner stays in one process.
+class WorkerCoordinator
+{
+	public:
+		WorkerCoordinator();
+		~WorkerCoordinator();
+		bool Start( int workercount,
+					const std::vector<cv::Mat>& frames,
+					uint64_t stagecachebytes );
+		int BlockFrames( int candidatecount ) const;
+		bool Run( const std::vector<LaneDetectConstants>& candidates,
+				  const uint32_t* frameindices,
+				  int framecount );
+		const Polygon* Polygons() const;
+		void Stop();
+		int workercount_;
+
+	protected:
+
+	private:
+		WorkerCoordinator( const WorkerCoordinator& ) = delete;
+		WorkerCoordinator& operator=( const WorkerCoordinator& ) = delete;
+		void WorkerMain( const std::vector<int>& cores );
+		void WorkerThread( const std::vector<LaneDetectConstants>& candidates );
+		bool WaitForWorkers();
+		uint32_t TaskBegin( int worker ) const;
+		WorkQueue* queue_;
+		Polygon* polygons_;
+		size_t mappingsize_;
+		std::vector<int> workers_;
+		std::vector<cv::Mat> frames_;
+		uint64_t stagecachebytes_;
+		StageCache* stagecache_;
+		int workerindex_;
+};
+
+#endif // WORKERCOORDINATOR_H